@@ -0,0 +1,22 @@
+#!/bin/bash
+# Appends to the same file from 100k commands to exercise the [>>] redirection cache.
+# The shell has to be built with -DNOPROMPT so the prompt doesn't end up in the output.
+#
+# usage: bench/append_redirect.sh {{path to DPUShell}} [command count]
+
+SHELL_BIN=${1:-./DPUShell}
+COUNT=${2:-100000}
+WORKDIR=$(mktemp -d)
+trap 'rm -rf "$WORKDIR"' EXIT
+
+for ((i = 0; i < COUNT; i++)); do
+    echo "/bin/echo $i >> $WORKDIR/append.log"
+done > "$WORKDIR/script"
+
+start=$(date +%s%N)
+"$SHELL_BIN" < "$WORKDIR/script" > /dev/null
+end=$(date +%s%N)
+
+elapsed=$((end - start))
+lines=$(wc -l < "$WORKDIR/append.log")
+echo "append_redirect commands=$COUNT lines_written=$lines total_ns=$elapsed ns_per_op=$((elapsed / COUNT))"
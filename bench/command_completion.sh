@@ -0,0 +1,47 @@
+#!/bin/bash
+# Tab completion latency over a PATH holding 50k executables spread across 10 directories.
+# The first lookup builds the index (index_ns), then 2000 command prefixes are completed and
+# p50/p99 come from the complete_ns lines the shell prints for [complete -t].
+# The shell has to be built with -DNOPROMPT so the prompt doesn't end up in the output.
+#
+# usage: bench/command_completion.sh {{path to DPUShell}} [executables] [lookups]
+
+SHELL_BIN=${1:-./DPUShell}
+COUNT=${2:-50000}
+LOOKUPS=${3:-2000}
+DIRS=10
+WORKDIR=$(mktemp -d)
+trap 'rm -rf "$WORKDIR"' EXIT
+
+path=""
+for ((d = 0; d < DIRS; d++)); do
+    mkdir "$WORKDIR/bin$d"
+    (cd "$WORKDIR/bin$d" && awk -v n="$COUNT" -v d="$d" -v dirs="$DIRS" 'BEGIN {
+        for (i = d; i < n; i += dirs) printf "cmd%c%c%05d\n", 97 + i % 26, 97 + int(i / 26) % 26, i
+    }' | xargs touch && chmod +x ./*)
+    path="$path${path:+:}$WORKDIR/bin$d"
+done
+
+{
+    echo "export PATH=$path"
+    echo "complete -t zzz"
+    awk -v n="$LOOKUPS" 'BEGIN {
+        srand(1)
+        for (i = 0; i < n; i++) {
+            len = int(rand() * 3)
+            prefix = "cmd"
+            for (k = 0; k < len; k++) prefix = prefix sprintf("%c", 97 + int(rand() * 26))
+            print "complete -t " prefix
+        }
+    }'
+} > "$WORKDIR/script"
+
+"$SHELL_BIN" < "$WORKDIR/script" | grep '^complete_ns=' | cut -d= -f2 > "$WORKDIR/times"
+
+index=$(head -n 1 "$WORKDIR/times")
+tail -n +2 "$WORKDIR/times" | sort -n > "$WORKDIR/sorted"
+n=$(wc -l < "$WORKDIR/sorted")
+p50=$(sed -n "$(((n * 50 + 99) / 100))p" "$WORKDIR/sorted")
+p99=$(sed -n "$(((n * 99 + 99) / 100))p" "$WORKDIR/sorted")
+
+echo "completion executables=$COUNT lookups=$n index_ns=$index p50_ns=$p50 p99_ns=$p99"
@@ -0,0 +1,36 @@
+#!/bin/bash
+# Substitutions per second for commands answered in-process (pwd, cat file) versus
+# the same commands forked from /bin. Each line is an assignment so nothing else forks.
+# The shell has to be built with -DNOPROMPT so the prompt doesn't end up in the output.
+#
+# usage: bench/command_substitution.sh {{path to DPUShell}} [substitution count]
+
+SHELL_BIN=${1:-./DPUShell}
+COUNT=${2:-10000}
+WORKDIR=$(mktemp -d)
+trap 'rm -rf "$WORKDIR"' EXIT
+
+echo 12345 > "$WORKDIR/pidfile"
+
+script() {
+    local inner=$1
+    for ((i = 0; i < COUNT; i++)); do
+        echo "BENCH_X=\$($inner)"
+    done
+}
+
+run() {
+    local name=$1 inner=$2
+    local start end elapsed
+    script "$inner" > "$WORKDIR/script"
+    start=$(date +%s%N)
+    "$SHELL_BIN" < "$WORKDIR/script" > /dev/null
+    end=$(date +%s%N)
+    elapsed=$((end - start))
+    echo "$name substitutions=$COUNT total_ns=$elapsed ns_per_op=$((elapsed / COUNT)) per_sec=$((COUNT * 1000000000 / elapsed))"
+}
+
+run subst_builtin_pwd "pwd"
+run subst_external_pwd "/bin/pwd"
+run subst_builtin_cat "cat $WORKDIR/pidfile"
+run subst_external_cat "/bin/cat $WORKDIR/pidfile"
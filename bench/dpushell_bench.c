@@ -0,0 +1,374 @@
+#define _GNU_SOURCE
+
+// dpushell_bench drives a DPUShell built with -DNOPROMPT through a fixed set of workloads and prints
+// one key=value line per workload, so the output of two builds can be diffed or compared with -b.
+//
+//   spawn     100k /bin/true launches
+//   parse     a generated corpus of lines the shell handles without forking (assignments, expansion,
+//             builtins, lines rejected by the parser)
+//   relay     GB of foreground job output relayed to the shell's stdout
+//   redirect  a script of [>], [>>], [<], [> a > b] and [cmd > out < in] lines
+//   jobs      background job churn, [/bin/true &] launched and reaped
+//
+// every workload runs [reps] times in a fresh temp dir with a fixed environment; the median wall time
+// of the runs that completed is reported (status=error when none did), with the user/sys time of that
+// run and the largest max RSS of all runs (wait4, it counts the shell and the children it waited for)
+//
+// usage: dpushell_bench [-s shell] [-w spawn,parse,...] [-r reps] [-q] [-b baseline] [-o results]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/utsname.h>
+#include <sys/wait.h>
+
+#ifndef DPUSHELL_NOPROMPT_PATH
+#define DPUSHELL_NOPROMPT_PATH "./DPUShellNoPrompt"
+#endif
+
+#define MAX_REPS 32
+#define DRAIN_SIZE (1024 * 1024)
+#define QUICK_DIVISOR 100
+
+typedef struct benchrun {
+    long long wall_ns;
+    long long user_ns;
+    long long sys_ns;
+    long max_rss_kb;
+    long long output_bytes;
+    int status;
+} benchrun;
+
+typedef struct benchworkload {
+    const char *name;
+    long long full_ops; // ops at full scale, quick runs divide by QUICK_DIVISOR
+    const char *unit; // what one op is
+    void (*writeScript)(FILE *script, long long ops);
+} benchworkload;
+
+//////////////////////////////////////////////////////////////////
+// Workload scripts
+//////////////////////////////////////////////////////////////////
+
+void writeSpawnScript(FILE *script, long long ops) {
+    for (long long i = 0; i < ops; i++) fputs("/bin/true\n", script);
+}
+
+// the same corpus every run, a line's kind only depends on its number
+void writeParseScript(FILE *script, long long ops) {
+    fputs("export BENCH_A=alpha\n", script);
+    fputs("BENCH_B=bravo\n", script);
+    for (long long i = 0; i < ops; i++) {
+        switch (i % 8) {
+            case 0:
+                fprintf(script, "BENCH_V%lld=$HOME/${BENCH_A}/$BENCH_B/x%lld\n", i % 64, i);
+                break;
+            case 1:
+                fprintf(script, "BENCH_W=${BENCH_V%lld}$BENCH_A$NOT_SET/${PATH}\n", (i / 8) % 64);
+                break;
+            case 2:
+                fprintf(script, "export BENCH_V%lld BENCH_B\n", i % 64);
+                break;
+            case 3:
+                fprintf(script, "unset BENCH_V%lld\n", (i + 32) % 64);
+                break;
+            case 4: // rejected, too many input redirects
+                fputs("sort < in1 < in2 < in3\n", script);
+                break;
+            case 5: // rejected, >>>
+                fputs("ls -la >>> out\n", script);
+                break;
+            case 6:
+                fputs("cd .\n", script);
+                break;
+            default: // rejected, no redirection file
+                fputs("cat -n <\n", script);
+                break;
+        }
+    }
+}
+
+void writeRelayScript(FILE *script, long long ops) {
+    fprintf(script, "head -c %lld /dev/zero\n", ops);
+}
+
+void writeRedirectScript(FILE *script, long long ops) {
+    fputs("/bin/echo seed > in0\n", script);
+    for (long long i = 0; i < ops; i++) {
+        switch (i % 5) {
+            case 0:
+                fprintf(script, "/bin/echo line %lld > out%lld\n", i, i % 8);
+                break;
+            case 1:
+                fprintf(script, "/bin/echo line %lld >> log\n", i);
+                break;
+            case 2:
+                fputs("/bin/cat < in0\n", script);
+                break;
+            case 3:
+                fprintf(script, "sort > sorted < out%lld\n", (i / 5) % 8);
+                break;
+            default:
+                fprintf(script, "/bin/echo fan %lld > fan1 > fan2\n", i);
+                break;
+        }
+    }
+}
+
+void writeJobsScript(FILE *script, long long ops) {
+    for (long long i = 0; i < ops; i++) fputs("/bin/true &\n", script);
+}
+
+static benchworkload workloads[] = {
+        {"spawn",    100000,                          "launch", writeSpawnScript},
+        {"parse",    1000000,                         "line",   writeParseScript},
+        {"relay",    4LL * 1024 * 1024 * 1024,        "byte",   writeRelayScript},
+        {"redirect", 20000,                           "line",   writeRedirectScript},
+        {"jobs",     20000,                           "job",    writeJobsScript},
+        {NULL, 0, NULL, NULL}
+};
+
+//////////////////////////////////////////////////////////////////
+// Running the shell
+//////////////////////////////////////////////////////////////////
+
+long long nowNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+long long timevalNs(struct timeval tv) {
+    return tv.tv_sec * 1000000000LL + tv.tv_usec * 1000LL;
+}
+
+// runs shell with script as stdin inside dir, stdout and stderr are counted and thrown away
+int runShell(const char *shell, const char *script, const char *dir, benchrun *run) {
+    int out[2];
+    if (pipe2(out, O_CLOEXEC) < 0) return -1;
+    fcntl(out[0], F_SETPIPE_SZ, DRAIN_SIZE);
+    int devnull = open("/dev/null", O_WRONLY | O_CLOEXEC);
+
+    // a fixed environment, HOME points at the temp dir so the history file starts empty every run
+    char home[strlen(dir) + 8];
+    snprintf(home, sizeof(home), "HOME=%s", dir);
+    char *envp[] = {"PATH=/usr/bin:/bin", home, "LC_ALL=C", NULL};
+    char *argv[] = {(char *) shell, NULL};
+
+    long long start = nowNs();
+    pid_t pid = fork();
+    if (pid == 0) {
+        int in = open(script, O_RDONLY);
+        if (in < 0 || chdir(dir) < 0) _exit(127);
+        dup2(in, STDIN_FILENO);
+        dup2(out[1], STDOUT_FILENO);
+        dup2(out[1], STDERR_FILENO);
+        execve(shell, argv, envp);
+        _exit(127);
+    }
+    close(out[1]);
+    if (pid < 0) {
+        close(out[0]);
+        close(devnull);
+        return -1;
+    }
+
+    // splice keeps the harness out of the relay numbers, read covers a kernel without it
+    static char buffer[DRAIN_SIZE];
+    run->output_bytes = 0;
+    while (1) {
+        ssize_t n = splice(out[0], NULL, devnull, NULL, DRAIN_SIZE, SPLICE_F_MOVE);
+        if (n < 0 && errno == EINVAL) n = read(out[0], buffer, DRAIN_SIZE);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        run->output_bytes += n;
+    }
+    close(out[0]);
+    close(devnull);
+
+    struct rusage usage;
+    while (wait4(pid, &run->status, 0, &usage) < 0) {
+        if (errno != EINTR) return -1;
+    }
+    run->wall_ns = nowNs() - start;
+    run->user_ns = timevalNs(usage.ru_utime);
+    run->sys_ns = timevalNs(usage.ru_stime);
+    run->max_rss_kb = usage.ru_maxrss;
+    return 0;
+}
+
+void removeTree(const char *dir) {
+    pid_t pid = fork();
+    if (pid == 0) {
+        execl("/bin/rm", "rm", "-rf", dir, (char *) NULL);
+        _exit(127);
+    }
+    if (pid > 0) waitpid(pid, NULL, 0);
+}
+
+int compareRuns(const void *a, const void *b) {
+    long long x = ((const benchrun *) a)->wall_ns, y = ((const benchrun *) b)->wall_ns;
+    return (x > y) - (x < y);
+}
+
+//////////////////////////////////////////////////////////////////
+// Baseline comparison
+//////////////////////////////////////////////////////////////////
+
+// ns_per_op of a workload in an earlier results file, -1 if it isn't there
+double baselineNsPerOp(const char *baseline, const char *name) {
+    FILE *f = fopen(baseline, "r");
+    if (f == NULL) return -1;
+    char line[1024];
+    char key[64];
+    snprintf(key, sizeof(key), "workload=%s ", name);
+    double value = -1;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (strncmp(line, key, strlen(key)) != 0) continue;
+        char *p = strstr(line, " ns_per_op=");
+        if (p != NULL) value = strtod(p + strlen(" ns_per_op="), NULL);
+    }
+    fclose(f);
+    return value;
+}
+
+//////////////////////////////////////////////////////////////////
+// main
+//////////////////////////////////////////////////////////////////
+
+int workloadSelected(const char *list, const char *name) {
+    if (list == NULL) return 1;
+    size_t len = strlen(name);
+    for (const char *p = list; (p = strstr(p, name)) != NULL; p += len) {
+        if ((p == list || p[-1] == ',') && (p[len] == '\0' || p[len] == ',')) return 1;
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    const char *shell = DPUSHELL_NOPROMPT_PATH;
+    const char *selected = NULL;
+    const char *baseline = NULL;
+    const char *results = NULL;
+    int reps = 3;
+    int quick = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "s:w:r:qb:o:")) != -1) {
+        switch (opt) {
+            case 's': shell = optarg; break;
+            case 'w': selected = optarg; break;
+            case 'r': reps = atoi(optarg); break;
+            case 'q': quick = 1; break;
+            case 'b': baseline = optarg; break;
+            case 'o': results = optarg; break;
+            default:
+                fprintf(stderr, "usage: %s [-s shell] [-w spawn,parse,relay,redirect,jobs] [-r reps] [-q] "
+                                "[-b baseline] [-o results]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (reps < 1) reps = 1;
+    if (reps > MAX_REPS) reps = MAX_REPS;
+    // the shell is started inside each workload's temp dir, a relative path wouldn't resolve there
+    char *shell_path = realpath(shell, NULL);
+    if (shell_path == NULL || access(shell_path, X_OK) < 0) {
+        fprintf(stderr, "dpushell_bench: cannot run [%s], build it with -DNOPROMPT or pass -s\n", shell);
+        return 2;
+    }
+    shell = shell_path;
+
+    FILE *out = stdout;
+    if (results != NULL && (out = fopen(results, "w")) == NULL) {
+        perror("cannot open results file");
+        return 2;
+    }
+
+    // enough about the run to tell two result files apart
+    struct utsname host;
+    uname(&host);
+    fprintf(out, "# dpushell_bench shell=%s reps=%i scale=%s kernel=%s machine=%s cpus=%li\n", shell, reps,
+            quick ? "quick" : "full", host.release, host.machine, sysconf(_SC_NPROCESSORS_ONLN));
+    fflush(out);
+
+    int failed = 0;
+    for (benchworkload *w = workloads; w->name != NULL; w++) {
+        if (!workloadSelected(selected, w->name)) continue;
+        long long ops = quick ? w->full_ops / QUICK_DIVISOR : w->full_ops;
+
+        char dir[] = "/tmp/dpushell_bench.XXXXXX";
+        if (mkdtemp(dir) == NULL) {
+            perror("cannot create temp dir");
+            return 2;
+        }
+        char script[sizeof(dir) + 16];
+        snprintf(script, sizeof(script), "%s/script", dir);
+        FILE *f = fopen(script, "w");
+        if (f == NULL) {
+            perror("cannot write script");
+            removeTree(dir);
+            return 2;
+        }
+        w->writeScript(f, ops);
+        fclose(f);
+
+        // the scratch files are recreated per rep so each one starts from the same state
+        char work[sizeof(dir) + 16];
+        snprintf(work, sizeof(work), "%s/work", dir);
+
+        // only runs the shell finished count, a run that couldn't be started ends the workload
+        benchrun runs[MAX_REPS];
+        memset(runs, 0, sizeof(runs));
+        int completed = 0;
+        long max_rss_kb = 0;
+        int ok = 1;
+        for (int r = 0; r < reps; r++) {
+            mkdir(work, 0755);
+            int started = runShell(shell, script, work, &runs[completed]) == 0;
+            removeTree(work);
+            if (!started) {
+                perror("cannot run the shell");
+                break;
+            }
+            if (!WIFEXITED(runs[completed].status) || WEXITSTATUS(runs[completed].status) != 0) ok = 0;
+            if (runs[completed].max_rss_kb > max_rss_kb) max_rss_kb = runs[completed].max_rss_kb;
+            completed++;
+        }
+        removeTree(dir);
+
+        if (completed == 0) {
+            fprintf(out, "workload=%s ops=%lld unit=%s status=error\n", w->name, ops, w->unit);
+            fflush(out);
+            failed = 1;
+            continue;
+        }
+
+        qsort(runs, completed, sizeof(benchrun), compareRuns);
+        benchrun *median = &runs[completed / 2];
+        double ns_per_op = (double) median->wall_ns / ops;
+        double bytes_per_sec = median->output_bytes * 1e9 / median->wall_ns;
+
+        fprintf(out, "workload=%s ops=%lld unit=%s wall_ns=%lld ns_per_op=%.3f ops_per_sec=%.1f "
+                     "output_bytes=%lld bytes_per_sec=%.0f user_ns=%lld sys_ns=%lld max_rss_kb=%li runs=%i status=%s",
+                w->name, ops, w->unit, median->wall_ns, ns_per_op, ops * 1e9 / median->wall_ns,
+                median->output_bytes, bytes_per_sec, median->user_ns, median->sys_ns, max_rss_kb, completed,
+                ok && completed == reps ? "ok" : "failed");
+        if (baseline != NULL) {
+            double before = baselineNsPerOp(baseline, w->name);
+            if (before > 0) fprintf(out, " baseline_ns_per_op=%.3f delta_pct=%+.1f", before, (ns_per_op - before) * 100 / before);
+        }
+        fputc('\n', out);
+        fflush(out);
+        if (!ok || completed < reps) failed = 1;
+    }
+
+    if (out != stdout) fclose(out);
+    return failed;
+}
@@ -0,0 +1,33 @@
+#!/bin/bash
+# Glob expansion against a directory with 1M entries. Each pattern is expanded by the
+# shell and handed to /bin/true, so the time is one getdents64 pass, matching and sorting.
+# The shell has to be built with -DNOPROMPT so the prompt doesn't end up in the output.
+#
+# usage: bench/glob_expansion.sh {{path to DPUShell}} [entries] [repetitions]
+
+SHELL_BIN=${1:-./DPUShell}
+ENTRIES=${2:-1000000}
+REPEAT=${3:-10}
+WORKDIR=$(mktemp -d)
+trap 'rm -rf "$WORKDIR"' EXIT
+
+mkdir "$WORKDIR/dir"
+(cd "$WORKDIR/dir" && seq -f "file-%07g.log" 1 "$ENTRIES" | xargs touch)
+
+run() {
+    local name=$1 pattern=$2
+    local start end elapsed
+    for ((i = 0; i < REPEAT; i++)); do
+        echo "/bin/true $WORKDIR/dir/$pattern"
+    done > "$WORKDIR/script"
+    start=$(date +%s%N)
+    "$SHELL_BIN" < "$WORKDIR/script" > /dev/null
+    end=$(date +%s%N)
+    elapsed=$((end - start))
+    echo "$name entries=$ENTRIES expansions=$REPEAT total_ns=$elapsed ns_per_op=$((elapsed / REPEAT))"
+}
+
+# few matches, the cost is reading and matching every entry
+run glob_scan_few "file-00012[0-9]?.log"
+# ~1% of the directory, adds sorting and argv packing
+run glob_scan_some "file-*77.log"
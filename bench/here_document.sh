@@ -0,0 +1,38 @@
+#!/bin/bash
+# Feeds 100MB of inline data to a command through a here-document and through a
+# here-string built from $(cat file), both end up in a memfd instead of a temp file.
+# The shell has to be built with -DNOPROMPT so the prompt doesn't end up in the output.
+#
+# usage: bench/here_document.sh {{path to DPUShell}} [megabytes]
+
+SHELL_BIN=${1:-./DPUShell}
+MEGABYTES=${2:-100}
+WORKDIR=$(mktemp -d)
+trap 'rm -rf "$WORKDIR"' EXIT
+
+# 64 byte lines
+line=$(printf '%063d' 0)
+lines=$((MEGABYTES * 1024 * 1024 / 64))
+yes "$line" | head -n "$lines" > "$WORKDIR/data"
+bytes=$(stat -c %s "$WORKDIR/data")
+
+{
+    echo "/usr/bin/wc -c <<EOF"
+    cat "$WORKDIR/data"
+    echo "EOF"
+} > "$WORKDIR/heredoc"
+
+echo "/usr/bin/wc -c <<< \$(cat $WORKDIR/data)" > "$WORKDIR/herestring"
+
+run() {
+    local name=$1 script=$2
+    local start end elapsed
+    start=$(date +%s%N)
+    counted=$("$SHELL_BIN" < "$script")
+    end=$(date +%s%N)
+    elapsed=$((end - start))
+    echo "$name bytes=$bytes counted=$counted total_ns=$elapsed bytes_per_sec=$((bytes * 1000000000 / elapsed))"
+}
+
+run heredoc "$WORKDIR/heredoc"
+run herestring "$WORKDIR/herestring"
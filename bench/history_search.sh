@@ -0,0 +1,45 @@
+#!/bin/bash
+# History load time and reverse search latency at 1M, 10M and 50M entries.
+# load_cold indexes the whole log, load_warm starts from the saved [log].idx.
+# search latency is (100 searches - 1 search) / 99 for a query that only matches the oldest entry.
+# The shell has to be built with -DNOPROMPT so the prompt doesn't end up in the output.
+#
+# usage: bench/history_search.sh {{path to DPUShell}} [entry counts...]
+
+SHELL_BIN=${1:-./DPUShell}
+shift
+SIZES=${*:-1000000 10000000 50000000}
+WORKDIR=$(mktemp -d)
+trap 'rm -rf "$WORKDIR"' EXIT
+
+time_script() {
+    local script=$1
+    local start end
+    start=$(date +%s%N)
+    HISTFILE="$WORKDIR/history" "$SHELL_BIN" < "$script" > /dev/null
+    end=$(date +%s%N)
+    echo $((end - start))
+}
+
+echo "history 1" > "$WORKDIR/load"
+echo "history -s needle-0000001" > "$WORKDIR/search1"
+for ((i = 0; i < 100; i++)); do echo "history -s needle-0000001"; done > "$WORKDIR/search100"
+
+for entries in $SIZES; do
+    rm -f "$WORKDIR/history" "$WORKDIR/history.idx"
+    {
+        echo "echo needle-0000001"
+        awk -v n="$entries" 'BEGIN {
+            split("git status|make -j8|ls -la /var/log|cd /srv/DPUShell|tail -f /var/log/syslog|ssh ninja@10.0.0.", cmds, "|")
+            for (i = 1; i < n; i++) print cmds[i % 6 + 1] " " i
+        }'
+    } > "$WORKDIR/history"
+    bytes=$(stat -c %s "$WORKDIR/history")
+
+    cold=$(time_script "$WORKDIR/load")
+    warm=$(time_script "$WORKDIR/load")
+    one=$(time_script "$WORKDIR/search1")
+    hundred=$(time_script "$WORKDIR/search100")
+
+    echo "history entries=$entries bytes=$bytes load_cold_ns=$cold load_warm_ns=$warm search_ns=$(((hundred - one) / 99))"
+done
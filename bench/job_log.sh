@@ -0,0 +1,37 @@
+#!/bin/bash
+# Streams GB of output from background jobs into their logs (DPUSHELL_JOBLOG_DIR) and reports the
+# throughput and the shell's peak RSS, which should be the same for 1GB and 100GB.
+# Logs are written under [dir] (default: a temp dir), which needs room for jobs x DPUSHELL_JOBLOG_MB.
+# The shell has to be built with -DNOPROMPT so the prompt doesn't end up in the output.
+#
+# usage: bench/job_log.sh {{path to DPUShell}} [GB] [jobs] [dir]
+
+SHELL_BIN=${1:-./DPUShell}
+GB=${2:-10}
+JOBS=${3:-4}
+WORKDIR=$(mktemp -d ${4:+-p "$4"})
+trap 'rm -rf "$WORKDIR"' EXIT
+
+BYTES=$(awk -v gb="$GB" -v jobs="$JOBS" 'BEGIN { printf "%.0f", gb * 1024 * 1024 * 1024 / jobs }')
+HEAD=$(command -v head)
+
+# the shell's peak RSS, read by a child once the other jobs are done
+printf '#!/bin/sh\nwhile pgrep -P $PPID -x head > /dev/null; do sleep 0.1; done\ngrep VmHWM /proc/$PPID/status > %s\n' \
+    "$WORKDIR/rss.out" > "$WORKDIR/rss"
+chmod +x "$WORKDIR/rss"
+
+{
+    echo "DPUSHELL_JOBLOG_DIR=$WORKDIR"
+    for i in $(seq 1 "$JOBS"); do echo "$HEAD -c $BYTES /dev/zero &"; done
+    echo "$WORKDIR/rss &"
+} > "$WORKDIR/script"
+
+start=$(date +%s%N)
+"$SHELL_BIN" < "$WORKDIR/script" > /dev/null
+end=$(date +%s%N)
+
+rss_kb=$(awk '{ print $2 }' "$WORKDIR/rss.out")
+total=$((BYTES * JOBS))
+echo "job_log bytes=$total jobs=$JOBS" \
+     "bytes_per_sec=$((total * 1000000000 / (end - start)))" \
+     "shell_peak_rss_kb=$rss_kb"
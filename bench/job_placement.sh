@@ -0,0 +1,42 @@
+#!/bin/bash
+# Wall time for N concurrent CPU-bound jobs started with [&], without placement and with
+# DPUSHELL_PLACEMENT=roundrobin and =numa. Each job walks a 4MB awk array so a job that is
+# moved between cores, or that shares a core, loses its cache.
+# Background jobs inherit the shell's stdout, so the pipe into cat only closes once every job is done.
+# The shell has to be built with -DNOPROMPT so the prompt doesn't end up in the output.
+#
+# usage: bench/job_placement.sh {{path to DPUShell}} [jobs] [iterations per job]
+
+SHELL_BIN=${1:-./DPUShell}
+JOBS=${2:-$(nproc)}
+ITERATIONS=${3:-3000000}
+WORKDIR=$(mktemp -d)
+trap 'rm -rf "$WORKDIR"' EXIT
+
+cat > "$WORKDIR/spin.awk" <<AWK
+BEGIN {
+    for (i = 0; i < 65536; i++) a[i] = i
+    for (i = 0; i < $ITERATIONS; i++) s += a[(i * 7919) % 65536]
+    print s > "/dev/null"
+}
+AWK
+
+run() {
+    local policy=$1
+    {
+        [ -n "$policy" ] && echo "DPUSHELL_PLACEMENT=$policy"
+        for ((i = 0; i < JOBS; i++)); do echo "/usr/bin/awk -f $WORKDIR/spin.awk &"; done
+    } > "$WORKDIR/script"
+
+    local start end
+    start=$(date +%s%N)
+    "$SHELL_BIN" < "$WORKDIR/script" | cat > /dev/null
+    end=$(date +%s%N)
+    echo $((end - start))
+}
+
+none=$(run "")
+roundrobin=$(run roundrobin)
+numa=$(run numa)
+
+echo "placement jobs=$JOBS cpus=$(nproc) none_ns=$none roundrobin_ns=$roundrobin numa_ns=$numa"
@@ -0,0 +1,41 @@
+#!/bin/bash
+# Fans GB of output out to 3 files: the shell's multi-target redirect [> a > b > c] and in-shell
+# [| tee a b c] (both tee(2)/splice), against bash piping into the external tee binary.
+# Files are written under [dir] (default: a temp dir), which needs room for 3 x GB.
+# The shell has to be built with -DNOPROMPT so the prompt doesn't end up in the output.
+#
+# usage: bench/output_fanout.sh {{path to DPUShell}} [GB] [dir]
+
+SHELL_BIN=${1:-./DPUShell}
+GB=${2:-10}
+WORKDIR=$(mktemp -d ${3:+-p "$3"})
+trap 'rm -rf "$WORKDIR"' EXIT
+
+BYTES=$(awk -v gb="$GB" 'BEGIN { printf "%.0f", gb * 1024 * 1024 * 1024 }')
+HEAD=$(command -v head)
+TEE=$(command -v tee)
+
+time_command() {
+    local start end
+    rm -f "$WORKDIR"/out*
+    sync
+    start=$(date +%s%N)
+    "$@" > /dev/null
+    end=$(date +%s%N)
+    for f in "$WORKDIR"/out1 "$WORKDIR"/out2 "$WORKDIR"/out3; do
+        [ "$(stat -c %s "$f")" = "$BYTES" ] || echo "short output in $f" >&2
+    done
+    echo $((end - start))
+}
+
+echo "$HEAD -c $BYTES /dev/zero > $WORKDIR/out1 > $WORKDIR/out2 > $WORKDIR/out3" > "$WORKDIR/redirect"
+echo "$HEAD -c $BYTES /dev/zero | tee $WORKDIR/out1 $WORKDIR/out2 $WORKDIR/out3" > "$WORKDIR/tee"
+
+redirect=$(time_command "$SHELL_BIN" < "$WORKDIR/redirect")
+intee=$(time_command "$SHELL_BIN" < "$WORKDIR/tee")
+external=$(time_command bash -c "$HEAD -c $BYTES /dev/zero | $TEE $WORKDIR/out1 $WORKDIR/out2 > $WORKDIR/out3")
+
+echo "fanout bytes=$BYTES targets=3" \
+     "redirect_bytes_per_sec=$((BYTES * 1000000000 / redirect))" \
+     "tee_bytes_per_sec=$((BYTES * 1000000000 / intee))" \
+     "external_tee_bytes_per_sec=$((BYTES * 1000000000 / external))"
@@ -0,0 +1,40 @@
+#!/bin/bash
+# Commands/sec for 64 concurrent clients, each sending /bin/true lines over one connection to a
+# [DPUShell --serve] instance, against 64 concurrent loops that start a fresh shell per command.
+# The shell has to be built with -DNOPROMPT so the prompt doesn't end up in the output.
+#
+# usage: bench/serve_commands.sh {{path to DPUShell}} [clients] [commands per client]
+
+SHELL_BIN=${1:-./DPUShell}
+CLIENTS=${2:-64}
+COMMANDS=${3:-200}
+WORKDIR=$(mktemp -d)
+SERVER_PID=
+trap '[ -n "$SERVER_PID" ] && kill $SERVER_PID; rm -rf "$WORKDIR"' EXIT
+
+for ((i = 0; i < COMMANDS; i++)); do echo "/bin/true"; done > "$WORKDIR/commands"
+echo "/bin/true" > "$WORKDIR/one"
+
+"$SHELL_BIN" --serve "$WORKDIR/sock" &
+SERVER_PID=$!
+while [ ! -S "$WORKDIR/sock" ]; do sleep 0.01; done
+
+start=$(date +%s%N)
+for ((c = 0; c < CLIENTS; c++)); do
+    "$SHELL_BIN" --client "$WORKDIR/sock" < "$WORKDIR/commands" > /dev/null &
+done
+wait $(jobs -p | grep -v "^$SERVER_PID$")
+end=$(date +%s%N)
+served=$((end - start))
+
+start=$(date +%s%N)
+for ((c = 0; c < CLIENTS; c++)); do
+    (for ((i = 0; i < COMMANDS; i++)); do "$SHELL_BIN" < "$WORKDIR/one" > /dev/null; done) &
+done
+wait $(jobs -p | grep -v "^$SERVER_PID$")
+end=$(date +%s%N)
+spawned=$((end - start))
+
+total=$((CLIENTS * COMMANDS))
+echo "serve clients=$CLIENTS commands=$total served_per_sec=$((total * 1000000000 / served))" \
+     "spawned_per_sec=$((total * 1000000000 / spawned))"
@@ -0,0 +1,40 @@
+#!/bin/bash
+# Times expansion heavy lines: assignments (no fork, only expansion + parsing) and
+# /bin/true launches that pass the cached envp to every child.
+# The shell has to be built with -DNOPROMPT so the prompt doesn't end up in the output.
+#
+# usage: bench/variable_expansion.sh {{path to DPUShell}} [line count]
+
+SHELL_BIN=${1:-./DPUShell}
+COUNT=${2:-100000}
+WORKDIR=$(mktemp -d)
+trap 'rm -rf "$WORKDIR"' EXIT
+
+{
+    echo "export BENCH_A=alpha"
+    echo "BENCH_B=bravo"
+    for ((i = 0; i < COUNT; i++)); do
+        echo "BENCH_X=\$HOME/\${BENCH_A}/\$BENCH_B/\${PATH}/\$BENCH_A\$BENCH_B/\$NOT_SET/$i"
+    done
+} > "$WORKDIR/assign"
+
+SPAWN_COUNT=$((COUNT / 10))
+{
+    echo "export BENCH_A=alpha"
+    for ((i = 0; i < SPAWN_COUNT; i++)); do
+        echo "/bin/true \$HOME \${BENCH_A} \$PATH \$BENCH_A$i"
+    done
+} > "$WORKDIR/spawn"
+
+run() {
+    local name=$1 script=$2 ops=$3
+    local start end elapsed
+    start=$(date +%s%N)
+    "$SHELL_BIN" < "$script" > /dev/null
+    end=$(date +%s%N)
+    elapsed=$((end - start))
+    echo "$name lines=$ops total_ns=$elapsed ns_per_op=$((elapsed / ops))"
+}
+
+run expand_assign "$WORKDIR/assign" "$COUNT"
+run expand_spawn "$WORKDIR/spawn" "$SPAWN_COUNT"
@@ -1,3 +1,5 @@
+#define _GNU_SOURCE
+
 #include <stdio.h>
 #include <signal.h>
 #include <stdlib.h>
@@ -5,8 +7,22 @@
 #include <unistd.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <dirent.h>
+#include <stdint.h>
+#include <time.h>
+#include <poll.h>
+#include <sched.h>
+#include <termios.h>
+#include <sys/ioctl.h>
+#include <sys/inotify.h>
 #include <sys/types.h>
+#include <sys/syscall.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
 #define PIPE_READ 0
 #define PIPE_WRITE 1
@@ -14,6 +30,12 @@
 // read / write max sizes
 const int MAX_READ_SIZE = 1024;
 
+// size of the buffer dpuread pulls stdin into, lines are handed out of it one at a time
+#define INPUT_BUFFER_SIZE 65536
+
+// longest line the line editor holds, same as MAX_READ_SIZE (a file scope array needs a constant)
+#define EDITOR_LINE_SIZE 1024
+
 // Job States
 const int RUNNING_FOREGROUND = 1;
 const int RUNNING_BACKGROUND = 2;
@@ -25,14 +47,95 @@ const int STOPPED_BACKGROUND = 3;
 // Helpers
 //////////////////////////////////////////////////////////////////
 
+// reads a single line (including the trailing \n) into command
+// stdin is read in large chunks and buffered so scripts piped into the shell
+// are processed line by line instead of in 1024 byte slices
+static char input_buffer[INPUT_BUFFER_SIZE];
+static int input_buffer_start = 0;
+static int input_buffer_end = 0;
+
+// the prompt printed before each read, the line editor redraws it
+static char shell_prompt[EDITOR_LINE_SIZE + 8] = "";
+
+// set by SIGINT so the line editor can tell Ctrl-C apart from other interrupted reads
+static volatile sig_atomic_t interrupt_received = 0;
+
+// set by SIGTSTP so a relay woken by some other signal goes back to relaying
+static volatile sig_atomic_t stop_received = 0;
+
+int lineEditorRead(char *command);
+int pollJobLogs(struct pollfd *fds, int nfds, int timeout, const sigset_t *sigmask);
+
 int dpuread(char *command) {
+    int num_read = 0;
     command[0] = '\0';
-    int num_read;
-    while (command[0] == '\0') {
-        num_read = read(STDIN_FILENO, command, MAX_READ_SIZE);
+
+    // terminals get the line editor (history, completion), scripts are read as is
+    static int interactive = -1;
+    if (interactive == -1) interactive = isatty(STDIN_FILENO);
+    if (interactive) return lineEditorRead(command);
+
+    while (num_read < MAX_READ_SIZE - 1) {
+        if (input_buffer_start == input_buffer_end) {
+            // logged background jobs are drained while the script has nothing to say
+            struct pollfd in = {STDIN_FILENO, POLLIN, 0};
+            if (pollJobLogs(&in, 1, -1, NULL) < 0) continue;
+            int n = read(STDIN_FILENO, input_buffer, INPUT_BUFFER_SIZE);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) break; // EOF
+            input_buffer_start = 0;
+            input_buffer_end = n;
+        }
+
+        char c = input_buffer[input_buffer_start++];
+        command[num_read++] = c;
+        if (c == '\n') break;
     }
+
+    // a final line without a newline still needs one, main strips it
+    if (num_read > 0 && command[num_read - 1] != '\n') command[num_read++] = '\n';
+    command[num_read] = '\0';
     return num_read;
+}
+
+// splits a command on whitespace into a NULL terminated, newly allocated argv
+char **splitCommandWords(const char *command) {
+    int size = 8;
+    int count = 0;
+    char **words = malloc(size * sizeof(char *));
+    const char *p = command;
+
+    while (*p != '\0') {
+        while (*p == ' ' || *p == '\t' || *p == '\n') p++;
+        if (*p == '\0') break;
+        const char *start = p;
+        while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\n') p++;
+
+        if (count + 1 >= size) {
+            size *= 2;
+            words = realloc(words, size * sizeof(char *));
+        }
+        words[count++] = strndup(start, p - start);
+    }
+    words[count] = NULL;
+    return words;
+}
+
+// removes a trailing [&] (run in the background), returns 1 if there was one
+int stripBackgroundOperator(char *command) {
+    size_t len = strlen(command);
+    while (len > 0 && command[len - 1] == ' ') len--;
+    if (len == 0 || command[len - 1] != '&') return 0;
+
+    len--;
+    while (len > 0 && command[len - 1] == ' ') len--;
+    command[len] = '\0';
+    return 1;
+}
 
+void freeCommandWords(char **words) {
+    for (int i = 0; words[i] != NULL; i++) free(words[i]);
+    free(words);
 }
 
 int isValueInArray(int val, int *arr, int size) {
@@ -54,6 +157,11 @@ typedef struct job {
     char *command;
     size_t process_stdout_read_address;
     int readpipe;
+    int cpu; // core the job is pinned to, -1 if none
+    int node; // NUMA node the job is pinned to, -1 if none
+    char *log_path; // where the job's output is logged, NULL if it isn't
+    struct outputtarget *targets; // [> a > b] / [| tee] files of a stopped job, kept for fg
+    int target_count;
 } job;
 
 // create a job list
@@ -76,27 +184,56 @@ job *createJob(int pid, char *output_address_pointer, int readpipe, int state, c
     j->command = strdup(command);
     j->process_stdout_read_address = (size_t) output_address_pointer;
     j->readpipe = readpipe;
+    j->cpu = -1;
+    j->node = -1;
+    j->log_path = NULL;
+    j->targets = NULL;
+    j->target_count = 0;
 
     return j;
 }
 
+// logs of reaped jobs, so [joblog id] still finds them after the job is gone. oldest first,
+// the oldest is dropped once it is full
+#define FINISHED_JOBLOG_COUNT 64
+
+typedef struct finishedjoblog {
+    int id;
+    char *path;
+} finishedjoblog;
+
+static finishedjoblog finished_joblogs[FINISHED_JOBLOG_COUNT];
+static int finished_joblog_count = 0;
+
+void rememberFinishedJobLog(int id, char *path) {
+    if (finished_joblog_count == FINISHED_JOBLOG_COUNT) {
+        free(finished_joblogs[0].path);
+        memmove(finished_joblogs, finished_joblogs + 1, (FINISHED_JOBLOG_COUNT - 1) * sizeof(finishedjoblog));
+        finished_joblog_count--;
+    }
+    finished_joblogs[finished_joblog_count].id = id;
+    finished_joblogs[finished_joblog_count].path = path;
+    finished_joblog_count++;
+}
+
+void closeOutputTargets(struct outputtarget *targets, int count);
+
 void *removeJobFromJobsListByPID(jobsllist *jobs, int pid) {
     jobsllist *l = jobs;
     jobsllist *prev = NULL;
     while (l != NULL) {
-        if (l->job->pid == pid) {
-            if (l->next != NULL) {
-                jobsllist *tmp = l;
-                prev->next = l->next;
-                free(tmp);
-            } else {
-                if (prev != NULL) {
-                    // isn't the base DPUShell Job
-                    prev->next = NULL;
-                    free(l->job);
-                    free(l);
-                }
+        // the base DPUShell job (no prev) is never removed
+        if (l->job->pid == pid && prev != NULL) {
+            prev->next = l->next;
+            free(l->job->command);
+            if (l->job->log_path != NULL) rememberFinishedJobLog(l->job->id, l->job->log_path);
+            if (l->job->targets != NULL) {
+                closeOutputTargets(l->job->targets, l->job->target_count);
+                free(l->job->targets);
             }
+            free(l->job);
+            free(l);
+            return 0;
         }
         prev = l;
         l = l->next;
@@ -110,18 +247,36 @@ void *listJobsListJobs(jobsllist *jobs) {
 
         if (l->job->id != 0) { // bypass the DPUSHell Job
 
+            // placement and log, if the job got them
+            char placement[32] = "";
+            if (l->job->cpu >= 0) snprintf(placement, sizeof(placement), "\t[cpu %i]", l->job->cpu);
+            else if (l->job->node >= 0) snprintf(placement, sizeof(placement), "\t[node %i]", l->job->node);
+            if (l->job->log_path != NULL) {
+                size_t used = strlen(placement);
+                snprintf(placement + used, sizeof(placement) - used, "\t[log]");
+            }
+
             if (l->job->state == 1)
-                printf("[%i]\t[%i]\t[FOREGROUND]\t[%s]\n", l->job->id, l->job->pid, l->job->command);
+                printf("[%i]\t[%i]\t[FOREGROUND]\t[%s]%s\n", l->job->id, l->job->pid, l->job->command, placement);
             else if (l->job->state == 2)
-                printf("[%i]\t[%i]\t[BACKGROUND]\t[%s]\n", l->job->id, l->job->pid, l->job->command);
+                printf("[%i]\t[%i]\t[BACKGROUND]\t[%s]%s\n", l->job->id, l->job->pid, l->job->command, placement);
             else
-                printf("[%i]\t[%i]\t[STOPPED]\t[%s]\n", l->job->id, l->job->pid, l->job->command);
+                printf("[%i]\t[%i]\t[STOPPED]\t[%s]%s\n", l->job->id, l->job->pid, l->job->command, placement);
         }
         l = l->next;
     }
     return 0;
 }
 
+job *findJobByPID(jobsllist *jobs, int pid) {
+    jobsllist *l = jobs;
+    while (l != NULL) {
+        if (l->job != NULL && l->job->pid == pid) return l->job;
+        l = l->next;
+    }
+    return NULL;
+}
+
 // adds job to the jobslist
 void *addJobsListJob(jobsllist *jobslist, job *j) {
 
@@ -149,609 +304,4652 @@ void *addJobsListJob(jobsllist *jobslist, job *j) {
 }
 
 //////////////////////////////////////////////////////////////////
-// COMMAND STRUCTURES (holds all information about commands and builtin commands
+// SHELL VARIABLES (variable store, $VAR expansion and the environment handed to exec)
 //////////////////////////////////////////////////////////////////
 
-const int NO_CHARACTER = 0;
-const int GREATER_THAN_SYMBOL = 1;
-const int LESS_THAN_SYMBOL = 2;
-const int DOUBLE_GREATER_THAN_SYMBOL = 3;
-
-// holds the context in which the commands will be processed
-// errors, symbols, etc... as well as commands.
-typedef struct shellcontext {
-    int greater_than_count;
-    int less_than_count;
-    int triple_or_more_greater_than_symbol_errors;
-    struct shellcommand *shellcommand;
+extern char **environ;
+
+#define SHELL_VARIABLE_BUCKETS 256
+
+// each variable keeps its "NAME=value" string, so building envp is only collecting pointers
+typedef struct shellvariable {
+    char *name;
+    char *value; // points into entry, after the '='
+    char *entry;
+    int exported;
+    unsigned int hash;
+    struct shellvariable *next;
+} shellvariable;
+
+static shellvariable *shellvariables[SHELL_VARIABLE_BUCKETS];
+static int shell_exported_count = 0;
+
+// envp for exec, only rebuilt after an exported variable changes
+static char **shell_environ = NULL;
+static int shell_environ_dirty = 1;
+
+// FNV-1a, name doesn't need to be null terminated
+unsigned int hashVariableName(const char *name, size_t len) {
+    unsigned int hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash ^= (unsigned char) name[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
 
-} shellcontext;
+shellvariable *findShellVariable(const char *name, size_t len) {
+    unsigned int hash = hashVariableName(name, len);
+    shellvariable *v = shellvariables[hash % SHELL_VARIABLE_BUCKETS];
+    while (v != NULL) {
+        if (v->hash == hash && strncmp(v->name, name, len) == 0 && v->name[len] == '\0') return v;
+        v = v->next;
+    }
+    return NULL;
+}
 
-// struct to process command chains
-typedef struct shellcommand {
-    // individual command
-    char *command;
-    char *base_command;
-    char *arguments;
-    int proceeding_special_character;
-    struct shellcommand *next;
-} shellcommand;
+char *getShellVariable(const char *name) {
+    shellvariable *v = findShellVariable(name, strlen(name));
+    return v != NULL ? v->value : NULL;
+}
 
+int isVariableNameChar(char c, int first) {
+    if (c == '_' || (c >= 'A' && c <= 'Z') || (c >= 'a' && c <= 'z')) return 1;
+    return !first && c >= '0' && c <= '9';
+}
 
-// debug function
-void *listShellCommands(shellcommand *commands) {
-    shellcommand *l = commands;
-    while (l->next != NULL) {
-        printf("[%s]\n[%i]\n", l->command, l->proceeding_special_character);
-        l = l->next;
+int isValidVariableName(const char *name, size_t len) {
+    if (len == 0) return 0;
+    for (size_t i = 0; i < len; i++) {
+        if (!isVariableNameChar(name[i], i == 0)) return 0;
     }
-    return 0;
+    return 1;
 }
 
-shellcontext *processCommand(char *input) {
-
-    char cmd[strlen(input) + 1];
-    strncpy(cmd, input, sizeof(cmd));
+// sets (or creates) a variable, value NULL keeps the current value.
+// exported: 1 export, 0 don't export, -1 leave as is
+void setShellVariable(const char *name, const char *value, int exported) {
+    size_t namelen = strlen(name);
+    shellvariable *v = findShellVariable(name, namelen);
+
+    if (v == NULL) {
+        v = (struct shellvariable *) malloc(sizeof(struct shellvariable));
+        v->name = strdup(name);
+        v->entry = NULL;
+        v->exported = 0;
+        v->hash = hashVariableName(name, namelen);
+        v->next = shellvariables[v->hash % SHELL_VARIABLE_BUCKETS];
+        shellvariables[v->hash % SHELL_VARIABLE_BUCKETS] = v;
+        if (value == NULL) value = "";
+    }
 
-    shellcommand *c = (struct shellcommand *) malloc(sizeof(struct shellcommand));
+    if (value != NULL) {
+        size_t valuelen = strlen(value);
+        char *entry = malloc(namelen + valuelen + 2);
+        memcpy(entry, name, namelen);
+        entry[namelen] = '=';
+        memcpy(entry + namelen + 1, value, valuelen + 1);
+        free(v->entry);
+        v->entry = entry;
+        v->value = entry + namelen + 1;
+        if (v->exported) shell_environ_dirty = 1;
+    }
 
-    // trim command trailing/leading characters
-    char command_to_clean[strlen(cmd)];
+    if (exported != -1 && exported != v->exported) {
+        v->exported = exported;
+        shell_exported_count += exported ? 1 : -1;
+        shell_environ_dirty = 1;
+    }
+}
 
-    int titor = 0;
-    int trim_leading = 1;
+void unsetShellVariable(const char *name) {
+    unsigned int hash = hashVariableName(name, strlen(name));
+    shellvariable **link = &shellvariables[hash % SHELL_VARIABLE_BUCKETS];
+    while (*link != NULL) {
+        shellvariable *v = *link;
+        if (v->hash == hash && strcmp(v->name, name) == 0) {
+            *link = v->next;
+            if (v->exported) {
+                shell_exported_count--;
+                shell_environ_dirty = 1;
+            }
+            free(v->name);
+            free(v->entry);
+            free(v);
+            return;
+        }
+        link = &v->next;
+    }
+}
 
-    for (int u = 0; u < strlen(cmd); u++) {
-        if (trim_leading && (cmd[u] == ' ')) continue;
-        command_to_clean[titor] = cmd[u];
-        titor++;
-        trim_leading = 0;
+// loads the environment the shell was started with, everything in it is exported
+void initShellVariables(char **envp) {
+    for (int i = 0; envp != NULL && envp[i] != NULL; i++) {
+        char *eq = strchr(envp[i], '=');
+        if (eq == NULL) continue;
+        char name[eq - envp[i] + 1];
+        memcpy(name, envp[i], eq - envp[i]);
+        name[eq - envp[i]] = '\0';
+        setShellVariable(name, eq + 1, 1);
     }
+}
 
-    // remove trailing whitespace
-    int w;
-    for (w = titor - 1; w > 0; w--) {
-        if (command_to_clean[w] == ' ') {
-            titor--;
-        } else {
-            break;
+// returns the envp array for exec, children get the same prebuilt pointer array
+// until an exported variable is set, exported or unset
+char **getShellEnviron() {
+    if (!shell_environ_dirty) return shell_environ;
+
+    free(shell_environ);
+    shell_environ = malloc((shell_exported_count + 1) * sizeof(char *));
+    int e = 0;
+    for (int b = 0; b < SHELL_VARIABLE_BUCKETS; b++) {
+        for (shellvariable *v = shellvariables[b]; v != NULL; v = v->next) {
+            if (v->exported) shell_environ[e++] = v->entry;
         }
     }
+    shell_environ[e] = NULL;
+    shell_environ_dirty = 0;
+    return shell_environ;
+}
 
-    char cleaned_command[titor];
-    for (int q = 0; q < titor; q++) {
-        cleaned_command[q] = command_to_clean[q];
+// $(...) output is read this much at a time, from a pipe grown to SUBSTITUTION_PIPE_SIZE
+#define SUBSTITUTION_READ_SIZE 65536
+#define SUBSTITUTION_PIPE_SIZE (1024 * 1024)
+
+// growable output buffer used while expanding a line
+typedef struct expansionbuffer {
+    char *data;
+    size_t len;
+    size_t size;
+} expansionbuffer;
+
+void appendExpansion(expansionbuffer *buf, const char *src, size_t len) {
+    if (buf->len + len + 1 > buf->size) {
+        while (buf->len + len + 1 > buf->size) buf->size *= 2;
+        buf->data = realloc(buf->data, buf->size);
     }
+    memcpy(buf->data + buf->len, src, len);
+    buf->len += len;
+    buf->data[buf->len] = '\0';
+}
 
-    cleaned_command[titor] = '\0';
-    char *command = malloc(strlen(cleaned_command) + 1);
-    strcpy(command, cleaned_command);
+char *expandShellVariables(const char *input);
 
+// reads whatever is left in fd straight into buf, 64KB at a time
+void readAllIntoExpansion(expansionbuffer *buf, int fd) {
+    while (1) {
+        if (buf->size - buf->len < SUBSTITUTION_READ_SIZE + 1) {
+            buf->size = buf->len + SUBSTITUTION_READ_SIZE * 2;
+            buf->data = realloc(buf->data, buf->size);
+        }
+        // logged background jobs are drained while the command hasn't printed anything
+        struct pollfd in = {fd, POLLIN, 0};
+        if (pollJobLogs(&in, 1, -1, NULL) < 0) continue;
+        ssize_t n = read(fd, buf->data + buf->len, SUBSTITUTION_READ_SIZE);
+        if (n < 0 && errno == EINTR) continue;
+        if (n <= 0) break;
+        buf->len += n;
+    }
+    buf->data[buf->len] = '\0';
+}
 
-    // begin processing arrays and positions
-    int greater_than_count = 0;
-    int less_than_count = 0;
+// pwd, echo without flags and [cat file] are answered without forking.
+// returns 1 when the command was handled in-process
+int runBuiltinSubstitution(char **words, expansionbuffer *out) {
+    if (strcmp(words[0], "pwd") == 0 && words[1] == NULL) {
+        char cwd[4096];
+        if (getcwd(cwd, sizeof(cwd)) != NULL) appendExpansion(out, cwd, strlen(cwd));
+        return 1;
+    }
+    if (strcmp(words[0], "echo") == 0) {
+        // flags (-n, -e, ...) are left to the real echo
+        for (int i = 1; words[i] != NULL; i++) {
+            if (words[i][0] == '-') return 0;
+        }
+        for (int i = 1; words[i] != NULL; i++) {
+            if (i > 1) appendExpansion(out, " ", 1);
+            appendExpansion(out, words[i], strlen(words[i]));
+        }
+        return 1;
+    }
+    if (strcmp(words[0], "cat") == 0 && words[1] != NULL && words[2] == NULL && words[1][0] != '-') {
+        int fd = open(words[1], O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            perror("cat");
+            return 1;
+        }
+        // size the buffer for the whole file so it is read without reallocating
+        struct stat st;
+        if (fstat(fd, &st) == 0 && st.st_size > 0 && (size_t) st.st_size + 1 > out->size - out->len) {
+            out->size = out->len + st.st_size + SUBSTITUTION_READ_SIZE + 1;
+            out->data = realloc(out->data, out->size);
+        }
+        readAllIntoExpansion(out, fd);
+        close(fd);
+        return 1;
+    }
+    return 0;
+}
 
-    // get the counts to initialize the position arrays
-    int z = 0;
-    for (z = 0; command[z] != '\0'; z++) {
-        if (command[z] == '>') {
-            greater_than_count++;
+// runs the command inside $(...) and returns its output without trailing newlines.
+// external commands write into a pipe that is drained with large reads
+char *runCommandSubstitution(const char *inner) {
+    expansionbuffer out;
+    out.size = 256;
+    out.data = malloc(out.size);
+    out.len = 0;
+    out.data[0] = '\0';
+
+    char *expanded = expandShellVariables(inner);
+    char **words = splitCommandWords(expanded);
+    free(expanded);
+
+    if (words[0] != NULL && !runBuiltinSubstitution(words, &out)) {
+        int outPipe[2];
+        if (pipe2(outPipe, O_CLOEXEC) < 0) {
+            perror("error creating substitution pipe");
+            freeCommandWords(words);
+            return out.data;
         }
-        if (command[z] == '<') {
-            less_than_count++;
+        // fewer wakeups for commands that print a lot
+        fcntl(outPipe[PIPE_WRITE], F_SETPIPE_SZ, SUBSTITUTION_PIPE_SIZE);
+
+        char **child_environ = getShellEnviron();
+
+        // keep SIGCHLD from reaping the child so its status is collected here
+        sigset_t chld_mask, orig_mask;
+        sigemptyset(&chld_mask);
+        sigaddset(&chld_mask, SIGCHLD);
+        sigprocmask(SIG_BLOCK, &chld_mask, &orig_mask);
+
+        pid_t pid = fork();
+        if (pid == 0) {
+            sigprocmask(SIG_SETMASK, &orig_mask, NULL);
+            // stdin is not the child's to read, it holds the rest of the script
+            int devnull = open("/dev/null", O_RDONLY);
+            if (devnull >= 0) {
+                dup2(devnull, STDIN_FILENO);
+                close(devnull);
+            }
+            if (dup2(outPipe[PIPE_WRITE], STDOUT_FILENO) == -1) _exit(1);
+            environ = child_environ;
+            execvp(words[0], words);
+            // 127 when the command doesn't exist, 126 when it can't be run
+            int exec_errno = errno;
+            perror(words[0]);
+            _exit(exec_errno == ENOENT ? 127 : 126);
+        }
+
+        close(outPipe[PIPE_WRITE]);
+        if (pid > 0) {
+            readAllIntoExpansion(&out, outPipe[PIPE_READ]);
+            waitpid(pid, NULL, 0);
+        } else {
+            perror("cannot fork");
         }
+        close(outPipe[PIPE_READ]);
+        sigprocmask(SIG_SETMASK, &orig_mask, NULL);
     }
+    freeCommandWords(words);
 
-    // get the position within the array for all less than and greater than
-    int gposcount = 0;
-    int lposcount = 0;
+    while (out.len > 0 && out.data[out.len - 1] == '\n') out.data[--out.len] = '\0';
+    return out.data;
+}
 
-    int greater_than_positions[greater_than_count + 1];
-    int less_than_positions[less_than_count + 1];
-    greater_than_positions[0] = -1;
-    less_than_positions[0] = -1;
+// returns the ) closing the $( that starts right before p, NULL if unbalanced
+const char *findSubstitutionEnd(const char *p) {
+    int depth = 1;
+    for (; *p != '\0'; p++) {
+        if (*p == '(') depth++;
+        if (*p == ')' && --depth == 0) return p;
+    }
+    return NULL;
+}
 
-    int k;
-    for (k = 0; command[k] != '\0'; k++) {
-        if (command[k] == '>') {
-            greater_than_positions[gposcount] = k;
-            gposcount++;
+// expands $VAR, ${VAR} (unset variables expand to nothing) and $(command), \$ is a literal $.
+// returns a newly allocated string
+char *expandShellVariables(const char *input) {
+    // most lines have nothing to expand
+    if (strchr(input, '$') == NULL) return strdup(input);
+
+    expansionbuffer buf;
+    buf.size = strlen(input) * 2 + 64;
+    buf.data = malloc(buf.size);
+    buf.len = 0;
+    buf.data[0] = '\0';
+
+    const char *p = input;
+    while (*p != '\0') {
+        // copy everything up to the next $ in one go
+        const char *dollar = strchr(p, '$');
+        if (dollar == NULL) {
+            appendExpansion(&buf, p, strlen(p));
+            break;
         }
-        if (command[k] == '<') {
-            less_than_positions[lposcount] = k;
-            lposcount++;
+
+        if (dollar > p && dollar[-1] == '\\') {
+            appendExpansion(&buf, p, dollar - p - 1);
+            appendExpansion(&buf, "$", 1);
+            p = dollar + 1;
+            continue;
+        }
+        appendExpansion(&buf, p, dollar - p);
+
+        const char *name = dollar + 1;
+        size_t namelen = 0;
+        const char *after;
+        if (*name == '(') {
+            const char *close = findSubstitutionEnd(name + 1);
+            if (close == NULL) {
+                appendExpansion(&buf, "$", 1);
+                p = dollar + 1;
+                continue;
+            }
+            char *inner = strndup(name + 1, close - name - 1);
+            char *output = runCommandSubstitution(inner);
+            appendExpansion(&buf, output, strlen(output));
+            free(output);
+            free(inner);
+            p = close + 1;
+            continue;
+        }
+        if (*name == '{') {
+            name++;
+            const char *close = strchr(name, '}');
+            if (close == NULL || !isValidVariableName(name, close - name)) {
+                // not a variable reference, keep it as typed
+                appendExpansion(&buf, "$", 1);
+                p = dollar + 1;
+                continue;
+            }
+            namelen = close - name;
+            after = close + 1;
+        } else {
+            while (isVariableNameChar(name[namelen], namelen == 0)) namelen++;
+            if (namelen == 0) {
+                appendExpansion(&buf, "$", 1);
+                p = dollar + 1;
+                continue;
+            }
+            after = name + namelen;
         }
+
+        shellvariable *v = findShellVariable(name, namelen);
+        if (v != NULL) appendExpansion(&buf, v->value, strlen(v->value));
+        p = after;
     }
+    return buf.data;
+}
 
-    // set the element after the end to an unreasonably high number as to not
-    // interfere with the below comparison
-    less_than_positions[lposcount] = 10000000;
-    greater_than_positions[gposcount] = 10000000;
+// returns the first character after the piece of a word that starts at p: a '...' or "..." string,
+// a $(...) substitution, \$ or a single character. an unterminated quote runs to the end of the line
+const char *skipShellSpan(const char *p) {
+    if (p[0] == '\\' && p[1] == '$') return p + 2;
+    if (p[0] == '\'' || p[0] == '"') {
+        const char *close = strchr(p + 1, p[0]);
+        return close != NULL ? close + 1 : p + strlen(p);
+    }
+    if (p[0] == '$' && p[1] == '(') {
+        const char *close = findSubstitutionEnd(p + 2);
+        return close != NULL ? close + 1 : p + 2;
+    }
+    return p + 1;
+}
 
-    // combine both integer arrays and sort
-    int special_char_positions[greater_than_count + less_than_count + 1];
+const char *findShellWordEnd(const char *p) {
+    while (*p != '\0' && *p != ' ' && *p != '\t' && *p != '\n') p = skipShellSpan(p);
+    return p;
+}
 
-    int x;
-    int gpos = 0;
-    int lpos = 0;
+// overwrites quoted text and $(...) so a [<] or [>] inside them isn't taken for a redirection.
+// scan is a copy of the line, only used to find positions
+void maskShellSpans(char *scan) {
+    char *p = scan;
+    while (*p != '\0') {
+        char *end = (char *) skipShellSpan(p);
+        if (*p == '\'' || *p == '"' || (*p == '$' && p[1] == '(')) memset(p, '_', end - p);
+        p = end;
+    }
+}
 
-    for (x = 0; x < (greater_than_count + less_than_count); x++) {
+// expands each word on its own and joins them with single spaces, newly allocated.
+// the line is already split on its redirections, so nothing a value contains is parsed again
+char *expandShellWords(const char *text) {
+    expansionbuffer buf;
+    buf.size = strlen(text) + 64;
+    buf.data = malloc(buf.size);
+    buf.len = 0;
+    buf.data[0] = '\0';
 
-        if ((less_than_count > 0) && (greater_than_count > 0)) {
+    const char *p = text;
+    while (1) {
+        while (*p == ' ' || *p == '\t' || *p == '\n') p++;
+        if (*p == '\0') break;
+        const char *end = findShellWordEnd(p);
+        char *word = strndup(p, end - p);
+        char *expanded = expandShellVariables(word);
+        if (buf.len > 0) appendExpansion(&buf, " ", 1);
+        appendExpansion(&buf, expanded, strlen(expanded));
+        free(expanded);
+        free(word);
+        p = end;
+    }
+    return buf.data;
+}
 
-            if (greater_than_positions[gpos] < less_than_positions[lpos]) {
-                special_char_positions[x] = greater_than_positions[gpos];
-                gpos++;
-            } else {
-                special_char_positions[x] = less_than_positions[lpos];
-                lpos++;
-            }
-        } else if (greater_than_count > 0) {
-            special_char_positions[x] = greater_than_positions[gpos];
-            gpos++;
-        } else if (less_than_count > 0) {
-            special_char_positions[x] = less_than_positions[lpos];
-            lpos++;
+// the value of a NAME=value word: quotes are removed, nothing inside '...' is expanded
+char *expandAssignmentValue(const char *value, size_t len) {
+    expansionbuffer buf;
+    buf.size = len * 2 + 1;
+    buf.data = malloc(buf.size);
+    buf.len = 0;
+    buf.data[0] = '\0';
+
+    char quote = '\0';
+    for (size_t i = 0; i < len; i++) {
+        char ch = value[i];
+        if (quote == '\0' && (ch == '\'' || ch == '"')) quote = ch;
+        else if (ch == quote) quote = '\0';
+        else {
+            if (quote == '\'' && ch == '$') appendExpansion(&buf, "\\", 1);
+            appendExpansion(&buf, &ch, 1);
         }
     }
+    char *expanded = expandShellVariables(buf.data);
+    free(buf.data);
+    return expanded;
+}
 
-    shellcommand *tmpshcmd = c;
-
-    //initialize first shell command if > or < is in the first position of command
-    if ((command[0] == '<') || (command[0] == '>')) {
+// takes the NAME=value words off the front of a command. each ends at the first unquoted blank and is
+// added, expanded, to *assignments (NULL terminated, newly allocated). returns where the command starts
+const char *extractVariableAssignments(const char *command, char ***assignments) {
+    int count = 0;
+    const char *p = command;
+    while (1) {
+        while (*p == ' ' || *p == '\t') p++;
+        const char *eq = strchr(p, '=');
+        const char *end = findShellWordEnd(p);
+        if (eq == NULL || eq >= end || !isValidVariableName(p, eq - p)) break;
+
+        char *value = expandAssignmentValue(eq + 1, end - eq - 1);
+        char *assignment = malloc((eq - p) + strlen(value) + 2);
+        sprintf(assignment, "%.*s=%s", (int) (eq - p), p, value);
+        free(value);
+
+        *assignments = realloc(*assignments, (count + 2) * sizeof(char *));
+        (*assignments)[count++] = assignment;
+        (*assignments)[count] = NULL;
+        p = end;
+    }
+    return p;
+}
 
-        char placeholder[2];
-        placeholder[0] = '\0';
-        tmpshcmd->command = malloc(strlen(placeholder) + 1);
-        strcpy(tmpshcmd->command, placeholder);
+void assignShellVariable(char *assignment) {
+    char *eq = strchr(assignment, '=');
+    char name[eq - assignment + 1];
+    memcpy(name, assignment, eq - assignment);
+    name[eq - assignment] = '\0';
+    setShellVariable(name, eq + 1, -1);
+}
 
+//////////////////////////////////////////////////////////////////
+// HERE-DOCUMENTS ([<<WORD] and [<<< text] handed to the child as stdin)
+//////////////////////////////////////////////////////////////////
 
-        // determine the proceeding symbol
-        if (isValueInArray(0, greater_than_positions, greater_than_count)) {
-            tmpshcmd->proceeding_special_character = GREATER_THAN_SYMBOL;
-        } else if (isValueInArray(0, less_than_positions, less_than_count)) {
-            tmpshcmd->proceeding_special_character = LESS_THAN_SYMBOL;
-        } else {
-            tmpshcmd->proceeding_special_character = NO_CHARACTER;
+// bodies that fit in a pipe go through one, anything larger is written to a memfd
+// in HEREDOC_FLUSH_SIZE chunks. either way nothing touches the filesystem
+#define HEREDOC_PIPE_LIMIT 65536
+#define HEREDOC_FLUSH_SIZE (1024 * 1024)
+
+typedef struct heredocwriter {
+    expansionbuffer buf;
+    int fd; // memfd, -1 until the body outgrows HEREDOC_PIPE_LIMIT
+} heredocwriter;
+
+int writeHereDocument(heredocwriter *w, const char *data, size_t len) {
+    if (w->fd < 0) {
+        w->fd = memfd_create("dpushell-heredoc", MFD_CLOEXEC);
+        if (w->fd < 0) {
+            perror("cannot create here-document");
+            return -1;
         }
-        tmpshcmd->next = (struct shellcommand *) malloc(sizeof(struct shellcommand));
-        tmpshcmd = tmpshcmd->next;
-        tmpshcmd->next = NULL;
     }
-
-    int idx = 0; //hold the index bounds
-    int next;
-    int l;
-    for (l = 0; l <= (greater_than_count + less_than_count); l++) {
-        // iterate over each position
-        if (l < (greater_than_count + less_than_count)) {
-            next = special_char_positions[l];
-        } else {
-            next = strlen(command) + 1;
+    size_t written = 0;
+    while (written < len) {
+        ssize_t n = write(w->fd, data + written, len - written);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            perror("cannot write here-document");
+            return -1;
         }
+        written += n;
+    }
+    return 0;
+}
 
-        int chars_in_between_indexes = ((next - 1) - idx);
-        // check if anything exists between special characters
-        if (chars_in_between_indexes >= 0) {
+int flushHereDocument(heredocwriter *w) {
+    int result = writeHereDocument(w, w->buf.data, w->buf.len);
+    w->buf.len = 0;
+    return result;
+}
 
-            char tmp[chars_in_between_indexes + 1];
-            int tmpitor = 0;
+void appendHereDocument(heredocwriter *w, const char *data, size_t len) {
+    // large pieces (a here-string from $(cat file)) go straight to the memfd without a copy
+    if (len >= HEREDOC_FLUSH_SIZE) {
+        flushHereDocument(w);
+        writeHereDocument(w, data, len);
+        return;
+    }
+    appendExpansion(&w->buf, data, len);
+    if (w->buf.len >= HEREDOC_FLUSH_SIZE) flushHereDocument(w);
+}
 
-            int search_for_leading_whitespace = 1;
-            int m;
-            for (m = idx; m <= next - 1; m++) {
-                // bypass leading whitespace
-                if ((search_for_leading_whitespace) && (command[m] == ' ')) continue;
-                tmp[tmpitor] = command[m];
-                tmpitor++;
-                search_for_leading_whitespace = 0;
+// returns the fd the child reads the body from, positioned at the start
+int finishHereDocument(heredocwriter *w) {
+    int fd = -1;
+
+    if (w->fd < 0 && w->buf.len <= HEREDOC_PIPE_LIMIT) {
+        int hdPipe[2];
+        if (pipe2(hdPipe, O_CLOEXEC) == 0) {
+            // a pipe can be smaller than the default when the user is over its pipe quota
+            if (fcntl(hdPipe[PIPE_WRITE], F_GETPIPE_SZ) >= (int) w->buf.len &&
+                write(hdPipe[PIPE_WRITE], w->buf.data, w->buf.len) == (ssize_t) w->buf.len) {
+                fd = hdPipe[PIPE_READ];
+            } else {
+                close(hdPipe[PIPE_READ]);
             }
+            close(hdPipe[PIPE_WRITE]);
+        }
+    }
 
-            // remove trailing whitespace
-            int n;
-            for (n = tmpitor - 1; n > 0; n--) {
-                if (tmp[n] == ' ') {
-                    tmpitor--;
-                } else {
-                    break;
-                }
-            }
-            // create a new array without trailing characters
-            char rmtrailing[tmpitor];
-            for (int g = 0; g < tmpitor; g++) {
-                rmtrailing[g] = tmp[g];
-            }
+    if (fd < 0 && flushHereDocument(w) == 0) {
+        lseek(w->fd, 0, SEEK_SET);
+        fd = w->fd;
+    } else if (w->fd >= 0 && fd != w->fd) {
+        close(w->fd);
+    }
 
-            if (tmp[0] != '\0') {
-                rmtrailing[tmpitor] = '\0';
+    free(w->buf.data);
+    return fd;
+}
 
-                tmpshcmd->command = malloc(strlen(rmtrailing) + 1);
-                strcpy(tmpshcmd->command, rmtrailing);
+// appends the next input line (any length, including the \n) to line.
+// returns 0 at EOF
+int readInputLine(expansionbuffer *line) {
+    int got = 0;
+    while (1) {
+        if (input_buffer_start == input_buffer_end) {
+            // logged background jobs are drained while the script has nothing to say
+            struct pollfd in = {STDIN_FILENO, POLLIN, 0};
+            if (pollJobLogs(&in, 1, -1, NULL) < 0) continue;
+            int n = read(STDIN_FILENO, input_buffer, INPUT_BUFFER_SIZE);
+            if (n < 0 && errno == EINTR) continue;
+            if (n <= 0) return got;
+            input_buffer_start = 0;
+            input_buffer_end = n;
+        }
+        char *start = input_buffer + input_buffer_start;
+        char *nl = memchr(start, '\n', input_buffer_end - input_buffer_start);
+        int take = nl != NULL ? (int) (nl - start) + 1 : input_buffer_end - input_buffer_start;
+        appendExpansion(line, start, take);
+        input_buffer_start += take;
+        got = 1;
+        if (nl != NULL) return 1;
+    }
+}
 
-                // determine the proceeding symbol
-                if (isValueInArray(m, greater_than_positions, greater_than_count)) {
-                    tmpshcmd->proceeding_special_character = GREATER_THAN_SYMBOL;
-                } else if (isValueInArray(next, less_than_positions, less_than_count)) {
-                    tmpshcmd->proceeding_special_character = LESS_THAN_SYMBOL;
-                } else {
+// the [<<] or [<<<] in command, NULL when there is none. one inside quotes or $(...) doesn't count
+char *findHereDocumentOperator(char *command) {
+    char *scan = strdup(command);
+    maskShellSpans(scan);
+    char *op = strstr(scan, "<<");
+    if (op != NULL) op = command + (op - scan);
+    free(scan);
+    return op;
+}
 
-                    tmpshcmd->proceeding_special_character = NO_CHARACTER;
-                }
-                tmpshcmd->next = (struct shellcommand *) malloc(sizeof(struct shellcommand));
-                tmpshcmd = tmpshcmd->next;
-                tmpshcmd->next = NULL;
+// the body couldn't be stored, the command isn't run without its stdin
+int finishExtractedHereDocument(heredocwriter *w) {
+    int fd = finishHereDocument(w);
+    if (fd < 0) {
+        printf("ERROR - Cannot create here-document\n");
+        return -2;
+    }
+    return fd;
+}
+
+// cuts [<<WORD] or [<<< text] out of command and materializes its body.
+// returns the fd for the child's stdin, -1 when there is none and -2 on error
+int extractHereDocument(char *command) {
+    char *op = findHereDocumentOperator(command);
+    if (op == NULL) return -1;
+
+    heredocwriter w;
+    w.buf.size = 4096;
+    w.buf.data = malloc(w.buf.size);
+    w.buf.len = 0;
+    w.fd = -1;
+
+    if (op[2] == '<') {
+        // here-string, runs to the next redirection symbol outside quotes and $(...) or the end of the line
+        char *text = op + 3;
+        char *scan = strdup(text);
+        maskShellSpans(scan);
+        char *end = text + strcspn(scan, "<>");
+        free(scan);
+        while (*text == ' ') text++;
+        char *textend = end;
+        while (textend > text && textend[-1] == ' ') textend--;
+
+        char *raw = strndup(text, textend - text);
+        char *expanded = expandShellVariables(raw);
+        appendHereDocument(&w, expanded, strlen(expanded));
+        appendHereDocument(&w, "\n", 1);
+        free(expanded);
+        free(raw);
+
+        memmove(op, end, strlen(end) + 1);
+        return finishExtractedHereDocument(&w);
+    }
+
+    // here-document, the body is the following input lines up to the delimiter (taken literally)
+    char *word = op + 2;
+    while (*word == ' ') word++;
+    char *wordend = word + strcspn(word, " <>");
+    char delimiter[wordend - word + 1];
+    int dlen = 0;
+    for (char *c = word; c < wordend; c++) {
+        if (*c != '\'' && *c != '"') delimiter[dlen++] = *c;
+    }
+    delimiter[dlen] = '\0';
+    memmove(op, wordend, strlen(wordend) + 1);
+
+    if (dlen == 0) {
+        printf("ERROR - No here-document delimiter specified\n");
+        free(w.buf.data);
+        return -2;
+    }
+
+    expansionbuffer line;
+    line.size = MAX_READ_SIZE;
+    line.data = malloc(line.size);
+    while (1) {
+#ifndef NOPROMPT
+        printf("> ");
+        fflush(stdout);
+#endif
+        line.len = 0;
+        if (!readInputLine(&line)) {
+            printf("ERROR - here-document ended by end of input, wanted [%s]\n", delimiter);
+            break;
+        }
+        size_t content = line.len;
+        if (content > 0 && line.data[content - 1] == '\n') content--;
+        if (content == (size_t) dlen && memcmp(line.data, delimiter, dlen) == 0) break;
+        appendHereDocument(&w, line.data, line.len);
+    }
+    free(line.data);
+    return finishExtractedHereDocument(&w);
+}
+
+//////////////////////////////////////////////////////////////////
+// GLOBBING (*, ? and [...] in arguments are expanded by the parent before fork)
+//////////////////////////////////////////////////////////////////
+
+// directories are read with getdents64 into one large buffer, a 1M entry directory
+// takes a few dozen syscalls and d_type saves a stat per entry
+#define GLOB_DIRENT_BUFFER_SIZE (1024 * 1024)
+
+const int GLOB_LITERAL = 0;
+const int GLOB_ANY_CHAR = 1;
+const int GLOB_ANY_STRING = 2;
+const int GLOB_CHAR_CLASS = 3;
+
+typedef struct globtoken {
+    int type;
+    const char *literal; // GLOB_LITERAL, points into the pattern's literal storage
+    size_t len;
+    unsigned char class[32]; // GLOB_CHAR_CLASS bitmap
+} globtoken;
+
+// a pattern compiled once, then matched against every directory entry
+typedef struct globpattern {
+    globtoken *tokens;
+    int count;
+    char *literals;
+    int match_dotfiles;
+} globpattern;
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+int hasGlobCharacters(const char *word) {
+    return strpbrk(word, "*?[") != NULL;
+}
+
+globpattern *compileGlobPattern(const char *pattern) {
+    size_t plen = strlen(pattern);
+    globpattern *gp = malloc(sizeof(struct globpattern));
+    gp->tokens = malloc((plen + 1) * sizeof(struct globtoken));
+    gp->literals = malloc(plen + 1);
+    gp->count = 0;
+    gp->match_dotfiles = pattern[0] == '.';
+
+    size_t lit = 0;
+    const char *p = pattern;
+    while (*p != '\0') {
+        globtoken *t = &gp->tokens[gp->count];
+
+        if (*p == '*') {
+            // ** is the same as *
+            if (gp->count == 0 || gp->tokens[gp->count - 1].type != GLOB_ANY_STRING) {
+                t->type = GLOB_ANY_STRING;
+                gp->count++;
+            }
+            p++;
+            continue;
+        }
+        if (*p == '?') {
+            t->type = GLOB_ANY_CHAR;
+            gp->count++;
+            p++;
+            continue;
+        }
+        if (*p == '[') {
+            // find the closing ], a ] right after [ or [! is part of the class
+            const char *c = p + 1;
+            int negate = (*c == '!' || *c == '^');
+            if (negate) c++;
+            const char *end = c + (*c == ']');
+            while (*end != '\0' && *end != ']') end++;
+
+            if (*end == ']') {
+                t->type = GLOB_CHAR_CLASS;
+                memset(t->class, 0, sizeof(t->class));
+                for (; c < end; c++) {
+                    unsigned char lo = *c, hi = *c;
+                    if (c + 2 < end && c[1] == '-') {
+                        hi = c[2];
+                        c += 2;
+                    }
+                    for (unsigned int ch = lo; ch <= hi; ch++) t->class[ch >> 3] |= 1 << (ch & 7);
+                }
+                if (negate) {
+                    for (int b = 0; b < 32; b++) t->class[b] = ~t->class[b];
+                }
+                t->class[0] &= ~1; // never match the terminating \0
+                gp->count++;
+                p = end + 1;
+                continue;
+            }
+            // unterminated [ is an ordinary character
+        }
+
+        // literal run, merged with the previous literal when possible
+        if (*p == '\\' && p[1] != '\0') p++;
+        if (gp->count > 0 && gp->tokens[gp->count - 1].type == GLOB_LITERAL) {
+            gp->literals[lit++] = *p;
+            gp->tokens[gp->count - 1].len++;
+        } else {
+            t->type = GLOB_LITERAL;
+            t->literal = gp->literals + lit;
+            t->len = 1;
+            gp->literals[lit++] = *p;
+            gp->count++;
+        }
+        p++;
+    }
+    return gp;
+}
+
+void freeGlobPattern(globpattern *gp) {
+    free(gp->tokens);
+    free(gp->literals);
+    free(gp);
+}
+
+// iterative matcher, backtracks only to the most recent * so it never goes exponential
+int matchGlobPattern(globpattern *gp, const char *name) {
+    if (name[0] == '.' && !gp->match_dotfiles) return 0;
+
+    int t = 0;
+    const char *s = name;
+    int star_t = -1;
+    const char *star_s = NULL;
+
+    while (1) {
+        if (t < gp->count) {
+            globtoken *tok = &gp->tokens[t];
+            if (tok->type == GLOB_ANY_STRING) {
+                star_t = t++;
+                star_s = s;
+                continue;
+            }
+            if (tok->type == GLOB_LITERAL && strncmp(s, tok->literal, tok->len) == 0) {
+                s += tok->len;
+                t++;
+                continue;
+            }
+            if (tok->type == GLOB_ANY_CHAR && *s != '\0') {
+                s++;
+                t++;
+                continue;
+            }
+            if (tok->type == GLOB_CHAR_CLASS &&
+                (tok->class[(unsigned char) *s >> 3] & (1 << ((unsigned char) *s & 7)))) {
+                s++;
+                t++;
+                continue;
+            }
+        } else if (*s == '\0') {
+            return 1;
+        }
+
+        // mismatch, let the last * swallow one more character
+        if (star_t < 0 || *star_s == '\0') return 0;
+        s = ++star_s;
+        t = star_t + 1;
+    }
+}
+
+// sort entry, the first 8 bytes of the string as a big-endian integer so most
+// comparisons are decided without touching the string itself
+typedef struct globsortentry {
+    uint64_t key;
+    char *str;
+} globsortentry;
+
+int compareGlobSortEntries(const void *a, const void *b) {
+    const globsortentry *x = a;
+    const globsortentry *y = b;
+    if (x->key != y->key) return x->key < y->key ? -1 : 1;
+    return strcmp(x->str, y->str);
+}
+
+uint64_t globSortKey(const char *str) {
+    uint64_t key = 0;
+    int i = 0;
+    for (; i < 8 && str[i] != '\0'; i++) key = (key << 8) | (unsigned char) str[i];
+    return key << (8 * (8 - i));
+}
+
+// shared getdents64 buffer for globbing and the command index
+char *getDirentBuffer() {
+    static char *direntbuffer = NULL;
+    if (direntbuffer == NULL) direntbuffer = malloc(GLOB_DIRENT_BUFFER_SIZE);
+    return direntbuffer;
+}
+
+// expands one word, appending the sorted matches to out (growable).
+// the matches live in *arena, which the caller frees once they are copied.
+// returns the number of matches, the word is left alone by the caller when there are none
+int expandGlobWord(const char *word, char ***out, int *outcount, int *outsize, char **arena_out) {
+    char *direntbuffer = getDirentBuffer();
+
+    // only the last path component is a pattern, a trailing / matches directories only
+    size_t wlen = strlen(word);
+    int dirs_only = 0;
+    while (wlen > 1 && word[wlen - 1] == '/') {
+        wlen--;
+        dirs_only = 1;
+    }
+    char pattern_copy[wlen + 1];
+    memcpy(pattern_copy, word, wlen);
+    pattern_copy[wlen] = '\0';
+
+    char *slash = strrchr(pattern_copy, '/');
+    const char *component = slash != NULL ? slash + 1 : pattern_copy;
+    size_t prefixlen = slash != NULL ? (size_t) (slash - pattern_copy) + 1 : 0;
+    char dirpath[prefixlen + 2];
+    if (slash == NULL) {
+        strcpy(dirpath, ".");
+    } else {
+        memcpy(dirpath, pattern_copy, prefixlen);
+        dirpath[prefixlen] = '\0';
+    }
+    if (!hasGlobCharacters(component)) return 0;
+
+    int dirfd = open(dirpath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0) return 0;
+
+    globpattern *gp = compileGlobPattern(component);
+
+    // matches are packed into one arena as "prefix + name[/]\0"
+    size_t arenasize = 4096, arenalen = 0;
+    char *arena = malloc(arenasize);
+    int matches = 0, matchsize = 64;
+    size_t *offsets = malloc(matchsize * sizeof(size_t));
+
+    long nread;
+    while ((nread = syscall(SYS_getdents64, dirfd, direntbuffer, GLOB_DIRENT_BUFFER_SIZE)) > 0) {
+        for (long pos = 0; pos < nread;) {
+            struct linux_dirent64 *d = (struct linux_dirent64 *) (direntbuffer + pos);
+            pos += d->d_reclen;
+
+            const char *name = d->d_name;
+            if (name[0] == '.' && (name[1] == '\0' || (name[1] == '.' && name[2] == '\0'))) continue;
+            if (!matchGlobPattern(gp, name)) continue;
+
+            if (dirs_only && d->d_type != DT_DIR) {
+                // symlinks and filesystems without d_type still need a stat
+                struct stat st;
+                if (d->d_type != DT_UNKNOWN && d->d_type != DT_LNK) continue;
+                if (fstatat(dirfd, name, &st, 0) < 0 || !S_ISDIR(st.st_mode)) continue;
+            }
+
+            size_t namelen = strlen(name);
+            size_t need = prefixlen + namelen + dirs_only + 1;
+            if (arenalen + need > arenasize) {
+                while (arenalen + need > arenasize) arenasize *= 2;
+                arena = realloc(arena, arenasize);
+            }
+            if (matches == matchsize) {
+                matchsize *= 2;
+                offsets = realloc(offsets, matchsize * sizeof(size_t));
+            }
+            offsets[matches++] = arenalen;
+            memcpy(arena + arenalen, pattern_copy, prefixlen);
+            memcpy(arena + arenalen + prefixlen, name, namelen);
+            arenalen += prefixlen + namelen;
+            if (dirs_only) arena[arenalen++] = '/';
+            arena[arenalen++] = '\0';
+        }
+    }
+    close(dirfd);
+    freeGlobPattern(gp);
+
+    if (matches > 0) {
+        globsortentry *sorted = malloc(matches * sizeof(struct globsortentry));
+        for (int i = 0; i < matches; i++) {
+            sorted[i].str = arena + offsets[i];
+            // the shared prefix would make every key equal, key on the name
+            sorted[i].key = globSortKey(sorted[i].str + prefixlen);
+        }
+        qsort(sorted, matches, sizeof(struct globsortentry), compareGlobSortEntries);
+
+        if (*outcount + matches > *outsize) {
+            while (*outcount + matches > *outsize) *outsize *= 2;
+            *out = realloc(*out, *outsize * sizeof(char *));
+        }
+        for (int i = 0; i < matches; i++) (*out)[(*outcount)++] = sorted[i].str;
+        free(sorted);
+        *arena_out = arena;
+    } else {
+        free(arena);
+    }
+    free(offsets);
+    return matches;
+}
+
+// copies argv into a single allocation (pointer array followed by the strings),
+// so the whole thing is released with one free()
+char **packCommandArgv(char **words, int count) {
+    size_t strings = 0;
+    for (int i = 0; i < count; i++) strings += strlen(words[i]) + 1;
+
+    char **packed = malloc((count + 1) * sizeof(char *) + strings);
+    char *dest = (char *) (packed + count + 1);
+    for (int i = 0; i < count; i++) {
+        size_t len = strlen(words[i]) + 1;
+        memcpy(dest, words[i], len);
+        packed[i] = dest;
+        dest += len;
+    }
+    packed[count] = NULL;
+    return packed;
+}
+
+// splits a command into the argv handed to exec, expanding globs.
+// patterns that match nothing are passed on as typed. free the result with free()
+char **buildCommandArgv(const char *command) {
+    char **words = splitCommandWords(command);
+    int count = 0;
+    while (words[count] != NULL) count++;
+
+    if (!hasGlobCharacters(command)) {
+        char **packed = packCommandArgv(words, count);
+        freeCommandWords(words);
+        return packed;
+    }
+
+    int outsize = count + 8, outcount = 0;
+    char **out = malloc(outsize * sizeof(char *));
+    int arenacount = 0;
+    char *arenas[count];
+
+    for (int i = 0; i < count; i++) {
+        if (hasGlobCharacters(words[i]) &&
+            expandGlobWord(words[i], &out, &outcount, &outsize, &arenas[arenacount]) > 0) {
+            arenacount++;
+            continue;
+        }
+        if (outcount + 1 > outsize) {
+            outsize *= 2;
+            out = realloc(out, outsize * sizeof(char *));
+        }
+        out[outcount++] = words[i];
+    }
+
+    char **packed = packCommandArgv(out, outcount);
+    for (int i = 0; i < arenacount; i++) free(arenas[i]);
+    free(out);
+    freeCommandWords(words);
+    return packed;
+}
+
+//////////////////////////////////////////////////////////////////
+// COMMAND STRUCTURES (holds all information about commands and builtin commands
+//////////////////////////////////////////////////////////////////
+
+const int NO_CHARACTER = 0;
+const int GREATER_THAN_SYMBOL = 1;
+const int LESS_THAN_SYMBOL = 2;
+const int DOUBLE_GREATER_THAN_SYMBOL = 3;
+
+// holds the context in which the commands will be processed
+// errors, symbols, etc... as well as commands.
+typedef struct shellcontext {
+    int greater_than_count;
+    int less_than_count;
+    int triple_or_more_greater_than_symbol_errors;
+    int heredoc_fd; // stdin for [<<WORD] / [<<< text], -1 when there is none
+    char *tee_arguments; // what followed [| tee], NULL when there is none
+    int glob_in_child; // the job globs its own arguments, the caller can't wait on a large directory
+    char **assignments; // [NAME=value] words in front of the command, NULL when there are none
+    struct shellcommand *shellcommand;
+
+} shellcontext;
+
+// struct to process command chains
+typedef struct shellcommand {
+    // individual command
+    char *command;
+    char *base_command;
+    char *arguments;
+    int proceeding_special_character;
+    struct shellcommand *next;
+} shellcommand;
+
+
+// debug function
+void *listShellCommands(shellcommand *commands) {
+    shellcommand *l = commands;
+    while (l->next != NULL) {
+        printf("[%s]\n[%i]\n", l->command, l->proceeding_special_character);
+        l = l->next;
+    }
+    return 0;
+}
+
+shellcontext *processCommand(char *input) {
+
+    // a submitted line carries the output of its $(...), which can run to megabytes, and words grow
+    // when they are expanded. nothing sized by the line goes on the stack and lengths are taken once
+    size_t input_len = strlen(input);
+
+    shellcommand *c = (struct shellcommand *) malloc(sizeof(struct shellcommand));
+
+    // trim command trailing/leading characters
+    size_t start = 0;
+    while (start < input_len && input[start] == ' ') start++;
+    size_t end = input_len;
+    while (end > start + 1 && input[end - 1] == ' ') end--;
+
+    int command_len = end - start;
+    char *command = strndup(input + start, command_len);
+
+    // begin processing arrays and positions
+    int greater_than_count = 0;
+    int less_than_count = 0;
+
+    // symbols inside quotes or $(...) are not redirections, positions are taken from a masked copy
+    char *scan = strdup(command);
+    maskShellSpans(scan);
+
+    // get the counts to initialize the position arrays
+    int z = 0;
+    for (z = 0; scan[z] != '\0'; z++) {
+        if (scan[z] == '>') {
+            greater_than_count++;
+        }
+        if (scan[z] == '<') {
+            less_than_count++;
+        }
+    }
+
+    // get the position within the array for all less than and greater than
+    int gposcount = 0;
+    int lposcount = 0;
+
+    int *greater_than_positions = malloc((greater_than_count + 1) * sizeof(int));
+    int *less_than_positions = malloc((less_than_count + 1) * sizeof(int));
+    greater_than_positions[0] = -1;
+    less_than_positions[0] = -1;
+
+    int k;
+    for (k = 0; scan[k] != '\0'; k++) {
+        if (scan[k] == '>') {
+            greater_than_positions[gposcount] = k;
+            gposcount++;
+        }
+        if (scan[k] == '<') {
+            less_than_positions[lposcount] = k;
+            lposcount++;
+        }
+    }
+    free(scan);
+
+    // set the element after the end to an unreasonably high number as to not
+    // interfere with the below comparison
+    less_than_positions[lposcount] = 10000000;
+    greater_than_positions[gposcount] = 10000000;
+
+    // combine both integer arrays and sort
+    int *special_char_positions = malloc((greater_than_count + less_than_count + 1) * sizeof(int));
+
+    int x;
+    int gpos = 0;
+    int lpos = 0;
+
+    for (x = 0; x < (greater_than_count + less_than_count); x++) {
+
+        if ((less_than_count > 0) && (greater_than_count > 0)) {
+
+            if (greater_than_positions[gpos] < less_than_positions[lpos]) {
+                special_char_positions[x] = greater_than_positions[gpos];
+                gpos++;
+            } else {
+                special_char_positions[x] = less_than_positions[lpos];
+                lpos++;
+            }
+        } else if (greater_than_count > 0) {
+            special_char_positions[x] = greater_than_positions[gpos];
+            gpos++;
+        } else if (less_than_count > 0) {
+            special_char_positions[x] = less_than_positions[lpos];
+            lpos++;
+        }
+    }
+
+    shellcommand *tmpshcmd = c;
+
+    //initialize first shell command if > or < is in the first position of command
+    if ((command[0] == '<') || (command[0] == '>')) {
+
+        char placeholder[2];
+        placeholder[0] = '\0';
+        tmpshcmd->command = malloc(strlen(placeholder) + 1);
+        strcpy(tmpshcmd->command, placeholder);
+
+
+        // determine the proceeding symbol
+        if (isValueInArray(0, greater_than_positions, greater_than_count)) {
+            tmpshcmd->proceeding_special_character = GREATER_THAN_SYMBOL;
+        } else if (isValueInArray(0, less_than_positions, less_than_count)) {
+            tmpshcmd->proceeding_special_character = LESS_THAN_SYMBOL;
+        } else {
+            tmpshcmd->proceeding_special_character = NO_CHARACTER;
+        }
+        tmpshcmd->next = (struct shellcommand *) malloc(sizeof(struct shellcommand));
+        tmpshcmd = tmpshcmd->next;
+        tmpshcmd->next = NULL;
+    }
+
+    int idx = 0; //hold the index bounds
+    int next;
+    int l;
+    for (l = 0; l <= (greater_than_count + less_than_count); l++) {
+        // iterate over each position
+        if (l < (greater_than_count + less_than_count)) {
+            next = special_char_positions[l];
+        } else {
+            next = command_len + 1;
+        }
+
+        int chars_in_between_indexes = ((next - 1) - idx);
+        // check if anything exists between special characters
+        if (chars_in_between_indexes >= 0) {
+
+            char *tmp = malloc(chars_in_between_indexes + 2);
+            int tmpitor = 0;
+
+            int search_for_leading_whitespace = 1;
+            int m;
+            for (m = idx; m <= next - 1; m++) {
+                // bypass leading whitespace
+                if ((search_for_leading_whitespace) && (command[m] == ' ')) continue;
+                tmp[tmpitor] = command[m];
+                tmpitor++;
+                search_for_leading_whitespace = 0;
+            }
+
+            // remove trailing whitespace
+            int n;
+            for (n = tmpitor - 1; n > 0; n--) {
+                if (tmp[n] == ' ') {
+                    tmpitor--;
+                } else {
+                    break;
+                }
+            }
+            // cut off the trailing characters
+            tmp[tmpitor] = '\0';
+
+            if (tmp[0] != '\0') {
+                tmpshcmd->command = tmp;
+
+                // determine the proceeding symbol
+                if (isValueInArray(m, greater_than_positions, greater_than_count)) {
+                    tmpshcmd->proceeding_special_character = GREATER_THAN_SYMBOL;
+                } else if (isValueInArray(next, less_than_positions, less_than_count)) {
+                    tmpshcmd->proceeding_special_character = LESS_THAN_SYMBOL;
+                } else {
+
+                    tmpshcmd->proceeding_special_character = NO_CHARACTER;
+                }
+                tmpshcmd->next = (struct shellcommand *) malloc(sizeof(struct shellcommand));
+                tmpshcmd = tmpshcmd->next;
+                tmpshcmd->next = NULL;
+            } else {
+                free(tmp);
+            }
+        } else {
+            // handle the double symbol case [>>]
+            if (command[idx - 1] == '>' && command[next] == '>') {
+                tmpshcmd->command = malloc(2);
+                char carrots[3];
+                carrots[0] = command[idx - 1];
+                carrots[1] = command[next];
+                carrots[2] = '\0';
+
+                strcpy(tmpshcmd->command, carrots);
+                tmpshcmd->proceeding_special_character = DOUBLE_GREATER_THAN_SYMBOL;
+                tmpshcmd->next = (struct shellcommand *) malloc(sizeof(struct shellcommand));
+                tmpshcmd = tmpshcmd->next;
+                tmpshcmd->next = NULL;
+
+            }
+        }
+
+
+        idx = next + 1;
+    }
+
+    int triple_or_more_greater_than_symbol_errors = 0;
+    // clean up the linked list of commands
+    shellcommand *ll = c;
+    while (ll->next != NULL) {
+        // clean up >> & >>> duplicate entries
+        if ((ll->proceeding_special_character == GREATER_THAN_SYMBOL) &&
+            (ll->next->proceeding_special_character == DOUBLE_GREATER_THAN_SYMBOL)) {
+            // we have a potential case of >> or >>> n+1
+            // we need to verify that the next of the next symbol is not mis interpreted as >>
+            // this is an error case that needs to be accounted for
+            if ((ll->next->next != NULL) &&
+                (ll->next->next->proceeding_special_character == DOUBLE_GREATER_THAN_SYMBOL)) {
+                // we have hit the edge case of >>> or >> + n*(>) example: >>>>>>>>>>>
+                shellcommand *ltmp = ll->next;
+                while (ltmp->next != NULL
+                       && ltmp->next->proceeding_special_character == DOUBLE_GREATER_THAN_SYMBOL) {
+                    shellcommand *lltmp = ltmp;
+                    ltmp = ltmp->next;
+                    free(lltmp);
+                }
+                // we've by passed all of the double characters links now to clean up to indicate the error
+                ll->proceeding_special_character = DOUBLE_GREATER_THAN_SYMBOL;
+                ltmp->command[1] = '\0'; // remove the >> make >
+                ltmp->proceeding_special_character = GREATER_THAN_SYMBOL;
+                triple_or_more_greater_than_symbol_errors = 1;
+
+                if (ltmp->next != NULL) {
+                    ll->next = ltmp;
+                } else {
+                    ll->next = NULL;
+                }
+
+            } else {
+                // we have hit the >> case and need to clean up the mis-interpretation
+                shellcommand *ltmp = ll->next;
+                ll->proceeding_special_character = DOUBLE_GREATER_THAN_SYMBOL;
+                // skip the >> link and go to the next command
+                if (ll->next->next != NULL) {
+                    ll->next = ltmp->next;
+                    free(ltmp);
+                } else {
+                    ll->next = NULL;
+                }
+                // keep the correct count for the input redirects
+                greater_than_count = greater_than_count - 2;
+            }
+        }
+
+        ll = ll->next;
+    }
+
+    // variables and $(...) are expanded word by word now that the line is split, so a value holding
+    // [>] or [<] is never taken for a redirection. NAME=value words in front of the command are kept apart
+    char **assignments = NULL;
+    for (shellcommand *e = c; e->next != NULL; e = e->next) {
+        if (e->command == NULL || e->command[0] == '\0') continue;
+        const char *words = e == c ? extractVariableAssignments(e->command, &assignments) : e->command;
+        char *expanded = expandShellWords(words);
+        free(e->command);
+        e->command = expanded;
+    }
+
+    // a line of assignments alone leaves no command to take these from
+    c->base_command = strdup("");
+    c->arguments = strdup("");
+
+    shellcommand *lll = c;
+    // get the arguments from the context
+    while (lll->next != NULL) {
+        if (lll->command != NULL && lll->command[0] != '\0') {
+
+            int bitor = 0;
+            int aitor = 0;
+
+            size_t len = strlen(lll->command);
+            char *base_command = malloc(len + 1);
+            char *arguments = malloc(len + 1);
+
+            int done_with_base = 0;
+
+            for (size_t i = 0; i < len; i++) {
+
+                if (!done_with_base) {
+                    // process the base command
+                    if ((lll->command[i] != '\0') && lll->command[i] != ' ') {
+                        base_command[bitor] = lll->command[i];
+                        bitor++;
+                    }
+                    if (lll->command[i] == ' ') {
+                        done_with_base = 1;
+                    }
+                } else {
+                    // process the arguments
+                    if ((lll->command[i] != '\0' && lll->command[i] != '\n')) {
+                        arguments[aitor] = lll->command[i];
+                        aitor++;
+                    }
+                }
+            }
+
+            base_command[bitor] = '\0';
+            arguments[aitor] = '\0';
+
+            free(c->base_command);
+            c->base_command = base_command;
+
+            free(c->arguments);
+            c->arguments = arguments;
+        }
+        lll = lll->next;
+    }
+
+    free(greater_than_positions);
+    free(less_than_positions);
+    free(special_char_positions);
+    free(command);
+
+    shellcontext *sc = (struct shellcontext *) malloc(sizeof(struct shellcontext));
+    sc->greater_than_count = greater_than_count;
+    sc->less_than_count = less_than_count;
+    sc->triple_or_more_greater_than_symbol_errors = triple_or_more_greater_than_symbol_errors;
+    sc->heredoc_fd = -1;
+    sc->tee_arguments = NULL;
+    sc->glob_in_child = 0;
+    sc->assignments = assignments;
+    sc->shellcommand = c;
+
+    return sc;
+
+}
+
+//////////////////////////////////////////////////////////////////
+// REDIRECTION CACHE (keeps [>>] targets open between commands)
+//////////////////////////////////////////////////////////////////
+
+// scripts that log with [cmd >> file] append to the same few files over and over,
+// so the parent keeps those files open and the child only has to dup2 the fd.
+// entries are keyed by absolute path, a hit costs an fstat of the open fd and no path lookup.
+// a removed file (no links left) is reopened, one renamed away keeps getting the output
+// like it would for any program holding its log open
+#define REDIRECT_CACHE_SIZE 8
+
+typedef struct redirectcacheentry {
+    char *path; // absolute
+    int fd;
+    unsigned long last_used;
+} redirectcacheentry;
+
+static redirectcacheentry redirectcache[REDIRECT_CACHE_SIZE];
+static unsigned long redirectcache_clock = 0;
+static char *redirectcache_cwd = NULL; // relative targets are keyed on it, cd drops it
+
+// cd changed the directory relative targets are resolved against
+void redirectCacheChangedDirectory() {
+    free(redirectcache_cwd);
+    redirectcache_cwd = NULL;
+}
+
+// newly allocated absolute form of path, the name a cache entry is kept under
+char *redirectCacheKey(const char *path) {
+    if (path[0] == '/') return strdup(path);
+    if (redirectcache_cwd == NULL) {
+        redirectcache_cwd = getcwd(NULL, 0);
+        if (redirectcache_cwd == NULL) return strdup(path);
+    }
+    size_t size = strlen(redirectcache_cwd) + strlen(path) + 2;
+    char *key = malloc(size);
+    snprintf(key, size, "%s/%s", redirectcache_cwd, path);
+    return key;
+}
+
+void closeRedirectCacheEntry(redirectcacheentry *e) {
+    if (e->path == NULL) return;
+    close(e->fd);
+    free(e->path);
+    e->path = NULL;
+    e->fd = -1;
+}
+
+// drops any cached fd for the absolute path key
+void invalidateRedirectCacheKey(char *key) {
+    for (int i = 0; i < REDIRECT_CACHE_SIZE; i++) {
+        if (redirectcache[i].path != NULL && strcmp(redirectcache[i].path, key) == 0) {
+            closeRedirectCacheEntry(&redirectcache[i]);
+        }
+    }
+}
+
+// drops any cached fd for the path, used when the file is removed by the shell
+void invalidateRedirectCache(char *path) {
+    char *key = redirectCacheKey(path);
+    invalidateRedirectCacheKey(key);
+    free(key);
+}
+
+// returns an fd opened for appending to path, either from the cache or freshly opened.
+// the fd is owned by the cache (O_CLOEXEC), callers dup2 it and never close it.
+// returns -1 with errno set when the file can't be opened
+int getAppendRedirectFd(char *path) {
+    struct stat st;
+    int i;
+    char *key = redirectCacheKey(path);
+
+    for (i = 0; i < REDIRECT_CACHE_SIZE; i++) {
+        if (redirectcache[i].path != NULL && strcmp(redirectcache[i].path, key) == 0) {
+            if (fstat(redirectcache[i].fd, &st) == 0 && st.st_nlink > 0) {
+                redirectcache[i].last_used = ++redirectcache_clock;
+                free(key);
+                return redirectcache[i].fd;
+            }
+            closeRedirectCacheEntry(&redirectcache[i]); // removed behind the shell's back
+        }
+    }
+
+    int fd = open(key, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        free(key);
+        return -1;
+    }
+
+    // use an empty slot, otherwise evict the least recently used target
+    redirectcacheentry *slot = &redirectcache[0];
+    for (i = 0; i < REDIRECT_CACHE_SIZE; i++) {
+        if (redirectcache[i].path == NULL) {
+            slot = &redirectcache[i];
+            break;
+        }
+        if (redirectcache[i].last_used < slot->last_used) slot = &redirectcache[i];
+    }
+    closeRedirectCacheEntry(slot);
+
+    slot->path = key;
+    slot->fd = fd;
+    slot->last_used = ++redirectcache_clock;
+    return fd;
+}
+
+//////////////////////////////////////////////////////////////////
+// JOB LOGS (background job output kept in size-capped files, read with [joblog])
+//////////////////////////////////////////////////////////////////
+
+// with DPUSHELL_JOBLOG_DIR set, [&] and submitted jobs write into a pipe instead of the terminal and the
+// shell splices that pipe into DIR/dpushell-<pid>.log whenever it waits on something else: a key, script
+// input, a foreground job. The file is a header page and a ring of DPUSHELL_JOBLOG_MB (default 16) MB,
+// the oldest output is overwritten once the ring is full. Output never passes through the shell's memory.
+// the header is mmap'd by the shell and by readers, [written] tells a reader where new output ends
+
+#define JOBLOG_HEADER_SIZE 4096
+#define JOBLOG_MAGIC 0x676f6c6a75706400ULL
+#define JOBLOG_DEFAULT_MB 16
+#define JOBLOG_SPLICE_SIZE (1024 * 1024)
+#define JOBLOG_COPY_SIZE (64 * 1024)
+#define JOBLOG_FOLLOW_POLL_MS 100
+#define JOBLOG_DRAIN_POLL_MS 1000
+
+typedef struct joblogheader {
+    uint64_t magic;
+    uint64_t capacity; // bytes in the ring
+    volatile uint64_t written; // bytes ever written, the ring position is written % capacity
+    volatile uint32_t done; // the job closed its output, nothing more will be written
+} joblogheader;
+
+typedef struct activejoblog {
+    int pipe_fd; // read end of the job's output
+    int fd;
+    joblogheader *header;
+} activejoblog;
+
+static activejoblog *active_joblogs = NULL;
+static int active_joblog_count = 0;
+
+int jobLoggingEnabled() {
+    char *dir = getShellVariable("DPUSHELL_JOBLOG_DIR");
+    return dir != NULL && dir[0] != '\0';
+}
+
+// newly allocated path of a job's log, NULL when logging is off
+char *jobLogPath(int pid) {
+    if (!jobLoggingEnabled()) return NULL;
+    char *dir = getShellVariable("DPUSHELL_JOBLOG_DIR");
+    size_t size = strlen(dir) + 32;
+    char *path = malloc(size);
+    snprintf(path, size, "%s/dpushell-%i.log", dir, pid);
+    return path;
+}
+
+// starts splicing a job's output pipe into its log, returns the log's path or NULL
+// (and closes the pipe, the job then gets EPIPE) if the file can't be set up
+char *startJobLog(int pid, int pipe_fd) {
+    char *path = jobLogPath(pid);
+    char *value = getShellVariable("DPUSHELL_JOBLOG_MB");
+    long mb = value != NULL ? atol(value) : JOBLOG_DEFAULT_MB;
+    if (mb <= 0) mb = JOBLOG_DEFAULT_MB;
+    uint64_t capacity = (uint64_t) mb * 1024 * 1024;
+
+    // sparse, the ring only takes disk space as it fills
+    int fd = path != NULL ? open(path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) : -1;
+    joblogheader *header = MAP_FAILED;
+    if (fd >= 0 && ftruncate(fd, JOBLOG_HEADER_SIZE + capacity) == 0) {
+        header = mmap(NULL, JOBLOG_HEADER_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    if (header == MAP_FAILED) {
+        perror("cannot create job log");
+        if (fd >= 0) close(fd);
+        close(pipe_fd);
+        free(path);
+        return NULL;
+    }
+    header->capacity = capacity;
+    header->written = 0;
+    header->done = 0;
+    header->magic = JOBLOG_MAGIC;
+
+    fcntl(pipe_fd, F_SETFL, fcntl(pipe_fd, F_GETFL) | O_NONBLOCK);
+    fcntl(pipe_fd, F_SETPIPE_SZ, JOBLOG_SPLICE_SIZE);
+    active_joblogs = realloc(active_joblogs, (active_joblog_count + 1) * sizeof(activejoblog));
+    active_joblogs[active_joblog_count].pipe_fd = pipe_fd;
+    active_joblogs[active_joblog_count].fd = fd;
+    active_joblogs[active_joblog_count].header = header;
+    active_joblog_count++;
+    return path;
+}
+
+void stopJobLog(int i) {
+    active_joblogs[i].header->done = 1;
+    munmap(active_joblogs[i].header, JOBLOG_HEADER_SIZE);
+    close(active_joblogs[i].fd);
+    close(active_joblogs[i].pipe_fd);
+    active_joblogs[i] = active_joblogs[--active_joblog_count];
+}
+
+// moves whatever the jobs have written into their logs, never blocks
+void serviceJobLogs() {
+    for (int i = active_joblog_count - 1; i >= 0; i--) {
+        activejoblog *log = &active_joblogs[i];
+        // bounded so one chatty job can't keep the shell from everything else
+        for (int round = 0; round < 16; round++) {
+            uint64_t pos = log->header->written % log->header->capacity;
+            uint64_t room = log->header->capacity - pos;
+            loff_t off = JOBLOG_HEADER_SIZE + pos;
+            ssize_t n = splice(log->pipe_fd, NULL, log->fd, &off, room < JOBLOG_SPLICE_SIZE ? room : JOBLOG_SPLICE_SIZE,
+                               SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n > 0) {
+                log->header->written += n;
+                continue;
+            }
+            if (n < 0 && (errno == EAGAIN || errno == EINTR)) break;
+            stopJobLog(i); // EOF, every writer of the pipe is gone
+            break;
+        }
+    }
+}
+
+// poll(2) that keeps the job logs moving while it waits on fds. with a negative timeout it only
+// returns once one of fds is ready or a signal comes in, sigmask is used as in ppoll(2).
+// returns the number of ready fds, -1 with errno set on error
+int pollJobLogs(struct pollfd *fds, int nfds, int timeout, const sigset_t *sigmask) {
+    while (1) {
+        int total = nfds + active_joblog_count;
+        struct pollfd all[total + 1];
+        for (int i = 0; i < nfds; i++) all[i] = fds[i];
+        for (int i = 0; i < active_joblog_count; i++) {
+            all[nfds + i].fd = active_joblogs[i].pipe_fd;
+            all[nfds + i].events = POLLIN;
+            all[nfds + i].revents = 0;
+        }
+
+        struct timespec ts = {timeout / 1000, (timeout % 1000) * 1000000L};
+        int ready = ppoll(all, total, timeout < 0 ? NULL : &ts, sigmask);
+        if (ready < 0) return -1;
+
+        int mine = 0;
+        for (int i = 0; i < nfds; i++) {
+            fds[i].revents = all[i].revents;
+            if (all[i].revents) mine++;
+        }
+        if (ready > mine) serviceJobLogs();
+        if (mine > 0 || timeout >= 0 || nfds + active_joblog_count == 0) return mine;
+    }
+}
+
+double getQueueThreshold(const char *name, double fallback);
+
+// waits until every logged job has closed its output, the logs would lose their writer otherwise.
+// jobs still writing after DPUSHELL_JOBLOG_TIMEOUT seconds (default 60) are left to a detached
+// child that keeps splicing their logs, so the shell can exit
+void drainJobLogs() {
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    double timeout = getQueueThreshold("DPUSHELL_JOBLOG_TIMEOUT", 60);
+
+    while (active_joblog_count > 0) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9 >= timeout) {
+            fprintf(stderr, "%i jobs still writing after %gs, their logs go on in the background\n",
+                    active_joblog_count, timeout);
+            pid_t pid = fork();
+            if (pid == 0) {
+                // off the terminal, and not holding the shell's stdout open for whoever reads it
+                setsid();
+                int devnull = open("/dev/null", O_RDWR);
+                if (devnull >= 0) {
+                    dup2(devnull, STDIN_FILENO);
+                    dup2(devnull, STDOUT_FILENO);
+                    dup2(devnull, STDERR_FILENO);
+                    close(devnull);
+                }
+                while (active_joblog_count > 0) pollJobLogs(NULL, 0, -1, NULL);
+                _exit(0);
+            }
+            if (pid < 0) perror("cannot keep the job logs going");
+            return;
+        }
+        pollJobLogs(NULL, 0, JOBLOG_DRAIN_POLL_MS, NULL);
+    }
+}
+
+// writes log bytes [from, to) to stdout, in chunks so a large log is never read in at once
+void printJobLogRange(int fd, uint64_t capacity, uint64_t from, uint64_t to) {
+    static char buffer[JOBLOG_COPY_SIZE];
+    while (from < to) {
+        uint64_t pos = from % capacity;
+        uint64_t len = to - from;
+        if (len > capacity - pos) len = capacity - pos;
+        if (len > JOBLOG_COPY_SIZE) len = JOBLOG_COPY_SIZE;
+        ssize_t n = pread(fd, buffer, len, JOBLOG_HEADER_SIZE + pos);
+        if (n <= 0 || write(STDOUT_FILENO, buffer, n) != n) return;
+        from += n;
+    }
+}
+
+// newly allocated log path of job id: a running job, else the latest finished job that had the id
+char *findJobLogPath(jobsllist *jobs, int id) {
+    // SIGCHLD moves reaped jobs from the list to finished_joblogs
+    sigset_t chld_mask, orig_mask;
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld_mask, &orig_mask);
+
+    char *path = NULL;
+    int found = 0;
+    for (jobsllist *l = jobs; l != NULL && !found; l = l->next) {
+        if (l->job->id != 0 && l->job->id == id) {
+            found = 1;
+            if (l->job->log_path != NULL) path = strdup(l->job->log_path);
+        }
+    }
+    for (int i = finished_joblog_count - 1; i >= 0 && !found; i--) {
+        if (finished_joblogs[i].id == id) {
+            found = 1;
+            path = strdup(finished_joblogs[i].path);
+        }
+    }
+
+    sigprocmask(SIG_SETMASK, &orig_mask, NULL);
+    return path;
+}
+
+// [joblog [-f] <id>] / [joblog [-f] -p <pid>] prints what a job logged, with -f it keeps printing until
+// the job is done or Ctrl-C. returns 1 when there is no such log
+int jobLogBuiltin(jobsllist *jobs, char *arguments) {
+    int follow = 0;
+    int by_pid = 0;
+    int number = -1;
+    char args[strlen(arguments) + 1];
+    strcpy(args, arguments);
+    char *saveptr;
+    for (char *arg = strtok_r(args, " ", &saveptr); arg != NULL; arg = strtok_r(NULL, " ", &saveptr)) {
+        if (strcmp(arg, "-f") == 0) follow = 1;
+        else if (strcmp(arg, "-p") == 0) by_pid = 1;
+        else number = atoi(arg);
+    }
+    if (number <= 0) {
+        printf("ERROR - joblog: usage joblog [-f] <id> or joblog [-f] -p <pid>\n");
+        return 1;
+    }
+
+    char *path = by_pid ? jobLogPath(number) : findJobLogPath(jobs, number);
+
+    int fd = path != NULL ? open(path, O_RDONLY | O_CLOEXEC) : -1;
+    joblogheader *header = fd >= 0 ? mmap(NULL, JOBLOG_HEADER_SIZE, PROT_READ, MAP_SHARED, fd, 0) : MAP_FAILED;
+    if (header == MAP_FAILED || header->magic != JOBLOG_MAGIC) {
+        printf("ERROR - joblog: no log for %s [%i]\n", by_pid ? "pid" : "job", number);
+        if (header != MAP_FAILED) munmap(header, JOBLOG_HEADER_SIZE);
+        if (fd >= 0) close(fd);
+        free(path);
+        return 1;
+    }
+    fflush(stdout);
+
+    uint64_t capacity = header->capacity;
+    uint64_t seen = 0;
+    interrupt_received = 0;
+    while (1) {
+        int done = header->done; // read before written, output that lands in between is printed next round
+        uint64_t written = header->written;
+        if (written - seen > capacity) seen = written - capacity; // overwritten already
+        printJobLogRange(fd, capacity, seen, written);
+        seen = written;
+        if (!follow || done || interrupt_received) break;
+        // the shell is the one filling the logs, it keeps doing so while following
+        pollJobLogs(NULL, 0, JOBLOG_FOLLOW_POLL_MS, NULL);
+    }
+
+    munmap(header, JOBLOG_HEADER_SIZE);
+    close(fd);
+    free(path);
+    return 0;
+}
+
+//////////////////////////////////////////////////////////////////
+// OUTPUT RELAY (job output to the terminal, and to several files for [> a > b] / [| tee files])
+//////////////////////////////////////////////////////////////////
+
+// the job's output pipe is grown to RELAY_PIPE_SIZE and moved with splice, so the bytes never pass
+// through the shell's memory. with several destinations every chunk is duplicated with tee(2)
+// into a second pipe of the same size and spliced from there, the last destination consumes it.
+// a destination that refuses splice (a tty) falls back to read/write through a buffer
+#define RELAY_PIPE_SIZE (1024 * 1024)
+#define RELAY_BUFFER_SIZE 65536
+#define MAX_OUTPUT_TARGETS 16
+
+typedef struct outputtarget {
+    int fd;
+    int splice_ok; // cleared the first time splice is refused
+} outputtarget;
+
+static outputtarget terminal_target = {STDOUT_FILENO, 1};
+
+// cuts a trailing [| tee [-a] files] off the line, returns what followed tee (newly allocated)
+// or NULL when the line doesn't end in a tee. any other [|] is left for the parser to reject
+char *extractTeeSuffix(char *command) {
+    char *bar = strrchr(command, '|');
+    if (bar == NULL) return NULL;
+
+    char *p = bar + 1;
+    while (*p == ' ') p++;
+    if (strncmp(p, "tee", 3) != 0 || (p[3] != ' ' && p[3] != '\0')) return NULL;
+
+    char *arguments = strdup(p + 3);
+    while (bar > command && bar[-1] == ' ') bar--;
+    *bar = '\0';
+    return arguments;
+}
+
+// [> a > b] (two or more output redirects) or a tee, the parent has to copy the output
+int hasOutputFanout(shellcontext *shcntx) {
+    if (shcntx->tee_arguments != NULL) return 1;
+    int outputs = 0;
+    for (shellcommand *l = shcntx->shellcommand; l->next != NULL; l = l->next) {
+        if (l->proceeding_special_character == GREATER_THAN_SYMBOL ||
+            l->proceeding_special_character == DOUBLE_GREATER_THAN_SYMBOL) {
+            outputs++;
+        }
+    }
+    return outputs > 1;
+}
+
+int addOutputTarget(outputtarget *targets, int count, const char *path, int append) {
+    if (count == MAX_OUTPUT_TARGETS) {
+        fprintf(stderr, "too many output files, %s skipped\n", path);
+        return count;
+    }
+    int fd = open(path, O_WRONLY | O_CREAT | O_CLOEXEC | (append ? O_APPEND : O_TRUNC), 0666);
+    if (fd < 0) {
+        perror(path);
+        return count;
+    }
+    targets[count].fd = fd;
+    targets[count].splice_ok = 1;
+    return count + 1;
+}
+
+// opens every destination of a fanout. the terminal (tee only) goes first so a file is last:
+// the last destination consumes the data and should be one that takes splice
+int openOutputTargets(shellcontext *shcntx, outputtarget *targets) {
+    int count = 0;
+    if (shcntx->tee_arguments != NULL) targets[count++] = terminal_target;
+
+    for (shellcommand *l = shcntx->shellcommand; l->next != NULL; l = l->next) {
+        if (l->proceeding_special_character == GREATER_THAN_SYMBOL ||
+            l->proceeding_special_character == DOUBLE_GREATER_THAN_SYMBOL) {
+            count = addOutputTarget(targets, count, l->next->command,
+                                    l->proceeding_special_character == DOUBLE_GREATER_THAN_SYMBOL);
+        }
+    }
+
+    if (shcntx->tee_arguments != NULL) {
+        char *expanded = expandShellVariables(shcntx->tee_arguments);
+        char **words = splitCommandWords(expanded);
+        int append = 0;
+        for (int i = 0; words[i] != NULL; i++) {
+            if (strcmp(words[i], "-a") == 0) append = 1;
+            else count = addOutputTarget(targets, count, words[i], append);
+        }
+        freeCommandWords(words);
+        free(expanded);
+    }
+    return count;
+}
+
+void closeOutputTargets(outputtarget *targets, int count) {
+    for (int i = 0; i < count; i++) {
+        if (targets[i].fd != STDOUT_FILENO) close(targets[i].fd);
+    }
+}
+
+// moves bytes from a pipe to a destination. with exact set len bytes are already in the pipe and
+// all of them are moved, otherwise it waits for data and moves what one call gets (0 at EOF)
+ssize_t movePipeOutput(int from, outputtarget *t, size_t len, int exact) {
+    static char *buffer = NULL;
+    size_t moved = 0;
+
+    do {
+        ssize_t n = -1;
+        if (t->splice_ok) {
+            n = splice(from, NULL, t->fd, NULL, len - moved, SPLICE_F_MOVE | SPLICE_F_MORE);
+            // EINVAL for a tty. any other failure also goes through the fallback, which
+            // drops the output of a destination that can't be written
+            if (n < 0 && errno != EINTR) t->splice_ok = 0;
+        }
+        if (!t->splice_ok) {
+            if (buffer == NULL) buffer = malloc(RELAY_BUFFER_SIZE);
+            n = read(from, buffer, len - moved < RELAY_BUFFER_SIZE ? len - moved : RELAY_BUFFER_SIZE);
+            for (ssize_t done = 0; n > 0 && done < n;) {
+                ssize_t w = write(t->fd, buffer + done, n - done);
+                if (w < 0) {
+                    if (errno == EINTR) continue;
+                    break; // a destination that went away doesn't stop the others
+                }
+                done += w;
+            }
+        }
+        if (n < 0 && errno == EINTR && exact) continue; // the data is already there, finish the chunk
+        if (n < 0) return -1;
+        if (n == 0) break;
+        moved += n;
+    } while (exact && moved < len);
+    return moved;
+}
+
+// relays a job's output until EOF (returns 0), or until a signal interrupts it (-1, the
+// job was stopped and keeps its pipe for fg)
+int relayOutput(int from, outputtarget *targets, int count) {
+    static int teepipe[2] = {-1, -1};
+    if (count > 1 && teepipe[PIPE_READ] < 0) {
+        if (pipe2(teepipe, O_CLOEXEC) < 0) return -1;
+        fcntl(teepipe[PIPE_WRITE], F_SETPIPE_SZ, RELAY_PIPE_SIZE);
+    }
+
+    stop_received = 0;
+    while (1) {
+        // logged background jobs keep going while a foreground job is relayed
+        if (active_joblog_count > 0) {
+            struct pollfd in = {from, POLLIN, 0};
+            if (pollJobLogs(&in, 1, -1, NULL) < 0) {
+                if (errno == EINTR && !stop_received) continue;
+                return -1;
+            }
+        }
+
+        if (count == 1) {
+            ssize_t n = movePipeOutput(from, &targets[0], RELAY_PIPE_SIZE, 0);
+            if (n <= 0) return n;
+            continue;
+        }
+
+        // waits for output; duplicated and not consumed, 0 means the writers are gone
+        ssize_t n = tee(from, teepipe[PIPE_WRITE], RELAY_PIPE_SIZE, 0);
+        if (n <= 0) return n == 0 ? 0 : -1;
+
+        for (int i = 0; i < count - 1; i++) {
+            // the tee pipe is empty again and as big as the first tee, so every later tee gets n too
+            if (i > 0 && tee(from, teepipe[PIPE_WRITE], n, 0) != n) return -1;
+            if (movePipeOutput(teepipe[PIPE_READ], &targets[i], n, 1) != n) return -1;
+        }
+        if (movePipeOutput(from, &targets[count - 1], n, 1) != n) return -1;
+    }
+}
+
+// a job stopped during a fanout keeps a copy of its destinations until fg relays into them
+// again or the job ends. the files are closed here when the job is already gone
+void keepJobOutputTargets(jobsllist *jobs, int pid, outputtarget *targets, int count) {
+    sigset_t chld_mask, orig_mask;
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld_mask, &orig_mask);
+
+    job *j = findJobByPID(jobs, pid);
+    if (j != NULL) {
+        j->targets = malloc(count * sizeof(outputtarget));
+        memcpy(j->targets, targets, count * sizeof(outputtarget));
+        j->target_count = count;
+    } else {
+        closeOutputTargets(targets, count);
+    }
+    sigprocmask(SIG_SETMASK, &orig_mask, NULL);
+}
+
+//////////////////////////////////////////////////////////////////
+// JOB PLACEMENT (opt-in CPU affinity for launched jobs, chosen by DPUSHELL_PLACEMENT)
+//////////////////////////////////////////////////////////////////
+
+// DPUSHELL_PLACEMENT=roundrobin pins every job to a single core and spreads jobs over the cores the
+// shell may run on. DPUSHELL_PLACEMENT=numa gives a job every core of one NUMA node and fills that
+// node before it moves on to the next one, so related jobs share a last level cache. Memory is
+// first touched after exec, so it is allocated on the job's own node.
+// Any other value, or no value, leaves placement to the kernel.
+
+#define PLACEMENT_MAX_NODES 64
+
+typedef struct placementtopology {
+    int loaded;
+    int cpus[CPU_SETSIZE]; // cpus the shell itself is allowed on
+    int cpucount;
+    cpu_set_t nodes[PLACEMENT_MAX_NODES]; // allowed cpus of each node that has any
+    int nodeids[PLACEMENT_MAX_NODES];
+    int nodecount;
+    int next_cpu; // round-robin cursor into cpus
+} placementtopology;
+
+static placementtopology topology;
+
+// parses a sysfs cpu list like "0-3,8-11"
+void parseCpuList(const char *list, cpu_set_t *set) {
+    const char *p = list;
+    while (*p != '\0' && *p != '\n') {
+        char *end;
+        long first = strtol(p, &end, 10);
+        if (end == p) break;
+        long last = first;
+        if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+        }
+        for (long cpu = first; cpu <= last && cpu < CPU_SETSIZE; cpu++) CPU_SET(cpu, set);
+        p = *end == ',' ? end + 1 : end;
+    }
+}
+
+// read once, the first time a job is placed
+void loadPlacementTopology() {
+    if (topology.loaded) return;
+    topology.loaded = 1;
+
+    cpu_set_t allowed;
+    CPU_ZERO(&allowed);
+    if (sched_getaffinity(0, sizeof(allowed), &allowed) < 0) return;
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed)) topology.cpus[topology.cpucount++] = cpu;
+    }
+
+    for (int node = 0; node < PLACEMENT_MAX_NODES; node++) {
+        char path[64];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", node);
+        FILE *f = fopen(path, "r");
+        if (f == NULL) continue;
+
+        char list[4096];
+        cpu_set_t *set = &topology.nodes[topology.nodecount];
+        CPU_ZERO(set);
+        if (fgets(list, sizeof(list), f) != NULL) parseCpuList(list, set);
+        fclose(f);
+
+        CPU_AND(set, set, &allowed);
+        if (CPU_COUNT(set) > 0) topology.nodeids[topology.nodecount++] = node;
+    }
+
+    // no sysfs node information, everything is one node
+    if (topology.nodecount == 0) {
+        topology.nodes[0] = allowed;
+        topology.nodeids[0] = 0;
+        topology.nodecount = 1;
+    }
+}
+
+// picks the affinity mask for the next job and the cpu or node it stands for (-1 otherwise).
+// returns 0 when placement is off. called with SIGCHLD blocked so the live job counts hold still
+int chooseJobPlacement(jobsllist *jobs, cpu_set_t *mask, int *cpu, int *node) {
+    *cpu = -1;
+    *node = -1;
+
+    char *policy = getShellVariable("DPUSHELL_PLACEMENT");
+    if (policy == NULL) return 0;
+    int numa = strcmp(policy, "numa") == 0;
+    if (!numa && strcmp(policy, "roundrobin") != 0) return 0;
+
+    loadPlacementTopology();
+    if (topology.cpucount == 0) return 0;
+
+    // placed jobs that are still alive, finished jobs are already off the list
+    int cpuload[CPU_SETSIZE] = {0};
+    int nodeload[PLACEMENT_MAX_NODES] = {0};
+    for (jobsllist *l = jobs; l != NULL; l = l->next) {
+        if (l->job == NULL || l->job->id == 0) continue;
+        if (l->job->cpu >= 0) cpuload[l->job->cpu]++;
+        for (int i = 0; i < topology.nodecount; i++) {
+            if (l->job->node >= 0 && topology.nodeids[i] == l->job->node) nodeload[i]++;
+        }
+    }
+
+    if (!numa) {
+        // the next core in turn, unless a later one has fewer jobs on it
+        int best = topology.next_cpu % topology.cpucount;
+        for (int k = 1; k < topology.cpucount; k++) {
+            int i = (topology.next_cpu + k) % topology.cpucount;
+            if (cpuload[topology.cpus[i]] < cpuload[topology.cpus[best]]) best = i;
+        }
+        topology.next_cpu = best + 1;
+
+        *cpu = topology.cpus[best];
+        CPU_ZERO(mask);
+        CPU_SET(*cpu, mask);
+        return 1;
+    }
+
+    // the first node with an idle core, once all are busy the one with the fewest jobs per core
+    int best = -1;
+    for (int i = 0; i < topology.nodecount && best < 0; i++) {
+        if (nodeload[i] < CPU_COUNT(&topology.nodes[i])) best = i;
+    }
+    if (best < 0) {
+        best = 0;
+        for (int i = 1; i < topology.nodecount; i++) {
+            if (nodeload[i] * CPU_COUNT(&topology.nodes[best]) < nodeload[best] * CPU_COUNT(&topology.nodes[i])) {
+                best = i;
+            }
+        }
+    }
+
+    *node = topology.nodeids[best];
+    *mask = topology.nodes[best];
+    return 1;
+}
+
+//////////////////////////////////////////////////////////////////
+// HISTORY (append-only log shared by every running shell, searched through an index)
+//////////////////////////////////////////////////////////////////
+
+// entries are "command\n" appended with a single O_APPEND write, so concurrent shells
+// never interleave. the log is mmap'd and indexed in blocks of HISTORY_BLOCK_ENTRIES,
+// each block has a bloom signature of the trigrams in its entries so a search only
+// memmem's blocks that can contain every trigram of the query.
+// the index is saved next to the log ([log].idx) so startup only indexes the new tail
+#define HISTORY_BLOCK_ENTRIES 64
+#define HISTORY_SIGNATURE_BITS 1024
+#define HISTORY_SIGNATURE_WORDS (HISTORY_SIGNATURE_BITS / 64)
+#define HISTORY_INDEX_MAGIC 0x3158444948555044ULL // "DPUHIDX1"
+
+typedef struct historyindexheader {
+    uint64_t magic;
+    uint64_t dev;
+    uint64_t ino;
+    uint64_t indexed;
+    uint64_t entries;
+    uint64_t blockcount;
+    uint64_t last_block_entries;
+} historyindexheader;
+
+typedef struct historylog {
+    int fd;
+    char *path;
+    pid_t owner; // forked children must never save the index
+    dev_t dev;
+    ino_t ino;
+    char *map;
+    size_t mapped;
+    size_t indexed; // bytes covered by the index, always ends on a \n
+    size_t saved_indexed; // bytes covered by the index file on disk
+    uint64_t truncations; // times the log got shorter, offsets from before one are void
+    uint64_t entries;
+    uint64_t *block_offsets; // file offset of each block's first entry
+    uint64_t (*block_signatures)[HISTORY_SIGNATURE_WORDS];
+    size_t blockcount;
+    size_t blocksize;
+    int last_block_entries;
+} historylog;
+
+static historylog history = {.fd = -1};
+
+unsigned int historyTrigramBit(const char *t) {
+    uint32_t v = ((uint32_t) (unsigned char) t[0] << 16) | ((uint32_t) (unsigned char) t[1] << 8) |
+                 (unsigned char) t[2];
+    return (v * 2654435761u) >> (32 - 10); // HISTORY_SIGNATURE_BITS == 1 << 10
+}
+
+void growHistoryBlocks(size_t needed) {
+    if (needed <= history.blocksize) return;
+    size_t size = history.blocksize == 0 ? 1024 : history.blocksize;
+    while (size < needed) size *= 2;
+    history.block_offsets = realloc(history.block_offsets, size * sizeof(uint64_t));
+    history.block_signatures = realloc(history.block_signatures, size * sizeof(*history.block_signatures));
+    history.blocksize = size;
+}
+
+// indexes complete entries between history.indexed and end
+void indexHistory(size_t end) {
+    const char *map = history.map;
+    size_t pos = history.indexed;
+
+    while (pos < end) {
+        const char *nl = memchr(map + pos, '\n', end - pos);
+        if (nl == NULL) break; // another shell is mid-write, pick it up next time
+        size_t linelen = nl - (map + pos);
+
+        if (history.blockcount == 0 || history.last_block_entries == HISTORY_BLOCK_ENTRIES) {
+            growHistoryBlocks(history.blockcount + 1);
+            history.block_offsets[history.blockcount] = pos;
+            memset(history.block_signatures[history.blockcount], 0, sizeof(*history.block_signatures));
+            history.blockcount++;
+            history.last_block_entries = 0;
+        }
+
+        uint64_t *sig = history.block_signatures[history.blockcount - 1];
+        for (size_t i = 0; i + 2 < linelen; i++) {
+            unsigned int bit = historyTrigramBit(map + pos + i);
+            sig[bit >> 6] |= 1ULL << (bit & 63);
+        }
+        history.last_block_entries++;
+        history.entries++;
+        pos += linelen + 1;
+    }
+    history.indexed = pos;
+}
+
+// maps anything other shells appended since the last call and indexes it. a log another shell
+// truncated is mapped and indexed again from the start, the old mapping past the new end would
+// SIGBUS; history.truncations tells holders of older offsets
+void refreshHistory() {
+    if (history.fd < 0) return;
+    struct stat st;
+    if (fstat(history.fd, &st) < 0) return;
+
+    if ((size_t) st.st_size < history.mapped) {
+        history.truncations++;
+        munmap(history.map, history.mapped);
+        history.map = NULL;
+        history.mapped = 0;
+        history.indexed = 0;
+        history.saved_indexed = SIZE_MAX; // the index file describes the old log, always rewrite it
+        history.entries = 0;
+        history.blockcount = 0;
+        history.last_block_entries = 0;
+    }
+    if ((size_t) st.st_size <= history.mapped) return;
+
+    char *map = history.mapped == 0
+                ? mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, history.fd, 0)
+                : mremap(history.map, history.mapped, st.st_size, MREMAP_MAYMOVE);
+    if (map == MAP_FAILED) return;
+    history.map = map;
+    history.mapped = st.st_size;
+    indexHistory(history.mapped);
+}
+
+// loads [log].idx if it still describes this log
+void loadHistoryIndex(struct stat *st) {
+    char idxpath[strlen(history.path) + 5];
+    sprintf(idxpath, "%s.idx", history.path);
+    int fd = open(idxpath, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return;
+
+    historyindexheader h;
+    if (read(fd, &h, sizeof(h)) == sizeof(h) && h.magic == HISTORY_INDEX_MAGIC &&
+        h.dev == (uint64_t) st->st_dev && h.ino == (uint64_t) st->st_ino && h.indexed <= (uint64_t) st->st_size) {
+        growHistoryBlocks(h.blockcount);
+        size_t offsetbytes = h.blockcount * sizeof(uint64_t);
+        size_t sigbytes = h.blockcount * sizeof(*history.block_signatures);
+        if (read(fd, history.block_offsets, offsetbytes) == (ssize_t) offsetbytes &&
+            read(fd, history.block_signatures, sigbytes) == (ssize_t) sigbytes) {
+            history.blockcount = h.blockcount;
+            history.entries = h.entries;
+            history.last_block_entries = h.last_block_entries;
+            history.indexed = h.indexed;
+            history.saved_indexed = h.indexed;
+        }
+    }
+    close(fd);
+}
+
+// writes the index next to the log, replaced atomically so other shells never read half of it
+void saveHistoryIndex() {
+    if (history.fd < 0 || getpid() != history.owner || history.indexed == history.saved_indexed) return;
+
+    char idxpath[strlen(history.path) + 5];
+    char tmppath[strlen(history.path) + 32];
+    sprintf(idxpath, "%s.idx", history.path);
+    sprintf(tmppath, "%s.idx.%d", history.path, (int) getpid());
+
+    int fd = open(tmppath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) return;
+
+    historyindexheader h;
+    h.magic = HISTORY_INDEX_MAGIC;
+    h.dev = history.dev;
+    h.ino = history.ino;
+    h.indexed = history.indexed;
+    h.entries = history.entries;
+    h.blockcount = history.blockcount;
+    h.last_block_entries = history.last_block_entries;
+
+    size_t offsetbytes = history.blockcount * sizeof(uint64_t);
+    size_t sigbytes = history.blockcount * sizeof(*history.block_signatures);
+    int ok = write(fd, &h, sizeof(h)) == sizeof(h) &&
+             write(fd, history.block_offsets, offsetbytes) == (ssize_t) offsetbytes &&
+             write(fd, history.block_signatures, sigbytes) == (ssize_t) sigbytes;
+    close(fd);
+
+    if (ok && rename(tmppath, idxpath) == 0) {
+        history.saved_indexed = history.indexed;
+    } else {
+        unlink(tmppath);
+    }
+}
+
+// opens $HISTFILE (default ~/.dpushell_history) and brings the index up to date
+void openHistory() {
+    char *histfile = getShellVariable("HISTFILE");
+    char *home = getShellVariable("HOME");
+    if (histfile != NULL && histfile[0] != '\0') {
+        history.path = strdup(histfile);
+    } else if (home != NULL) {
+        history.path = malloc(strlen(home) + 20);
+        sprintf(history.path, "%s/.dpushell_history", home);
+    } else {
+        return;
+    }
+
+    history.fd = open(history.path, O_RDWR | O_APPEND | O_CREAT | O_CLOEXEC, 0600);
+    if (history.fd < 0) return;
+    history.owner = getpid();
+
+    struct stat st;
+    if (fstat(history.fd, &st) < 0) return;
+    history.dev = st.st_dev;
+    history.ino = st.st_ino;
+
+    loadHistoryIndex(&st);
+    refreshHistory();
+    if (history.indexed > 0 && (history.mapped < history.indexed || history.map[history.indexed - 1] != '\n')) {
+        // the saved index doesn't line up with the log, start over
+        history.blockcount = 0;
+        history.entries = 0;
+        history.indexed = 0;
+        history.saved_indexed = 0;
+        indexHistory(history.mapped);
+    }
+    atexit(saveHistoryIndex);
+}
+
+void appendHistory(const char *line) {
+    if (history.fd < 0) return;
+    size_t len = strlen(line);
+    char entry[len + 1];
+    memcpy(entry, line, len);
+    entry[len] = '\n';
+    write(history.fd, entry, len + 1);
+}
+
+// returns the offset of the newest entry that starts before 'before' and contains
+// query, -1 if there is none. call with before == history.indexed to search everything
+long findHistoryMatch(const char *query, size_t qlen, size_t before) {
+    refreshHistory(); // never scan a mapping that runs past the end of a truncated log
+    if (history.map == NULL || qlen == 0) return -1;
+    if (before > history.indexed) before = history.indexed;
+
+    unsigned int bits[qlen > 2 ? qlen - 2 : 1];
+    size_t nbits = 0;
+    for (size_t i = 0; i + 2 < qlen; i++) bits[nbits++] = historyTrigramBit(query + i);
+
+    for (size_t b = history.blockcount; b-- > 0;) {
+        size_t start = history.block_offsets[b];
+        if (start >= before) continue;
+
+        uint64_t *sig = history.block_signatures[b];
+        size_t k;
+        for (k = 0; k < nbits; k++) {
+            if (!(sig[bits[k] >> 6] & (1ULL << (bits[k] & 63)))) break;
+        }
+        if (k < nbits) continue;
+
+        size_t end = b + 1 < history.blockcount ? history.block_offsets[b + 1] : history.indexed;
+        if (end > before) end = before;
+
+        // last match in the block, the query never spans entries as it has no \n
+        long found = -1;
+        const char *p = history.map + start;
+        const char *blockend = history.map + end;
+        const char *hit;
+        while ((hit = memmem(p, blockend - p, query, qlen)) != NULL) {
+            const char *linestart = memrchr(history.map + start, '\n', hit - (history.map + start));
+            found = linestart != NULL ? linestart + 1 - history.map : (long) start;
+            const char *nl = memchr(hit, '\n', blockend - hit);
+            if (nl == NULL) break;
+            p = nl + 1;
+        }
+        if (found >= 0) return found;
+    }
+    return -1;
+}
+
+// writes the entry starting at offset, including its \n
+void printHistoryEntry(size_t offset) {
+    const char *nl = memchr(history.map + offset, '\n', history.indexed - offset);
+    fwrite(history.map + offset, 1, nl - (history.map + offset) + 1, stdout);
+}
+
+// [history] lists every entry, [history n] the last n, [history -s text [n]] the newest n
+// entries containing text (10 by default), newest first
+void historyBuiltin(char *arguments) {
+    refreshHistory();
+    if (history.map == NULL) return;
+
+    if (strncmp(arguments, "-s ", 3) == 0) {
+        char *query = arguments + 3;
+        while (*query == ' ') query++;
+        long limit = 10;
+        char *lastspace = strrchr(query, ' ');
+        if (lastspace != NULL && lastspace[1] != '\0' && strspn(lastspace + 1, "0123456789") == strlen(lastspace + 1)) {
+            limit = atol(lastspace + 1);
+            *lastspace = '\0';
+        }
+
+        size_t before = history.indexed;
+        long offset;
+        while (limit-- > 0 && (offset = findHistoryMatch(query, strlen(query), before)) >= 0) {
+            printHistoryEntry(offset);
+            before = offset;
+        }
+        fflush(stdout);
+        return;
+    }
+
+    // walk back n entries from the end, then the rest goes out in one write
+    size_t start = 0;
+    if (arguments[0] != '\0') {
+        long n = atol(arguments);
+        start = history.indexed;
+        while (n-- > 0 && start > 0) {
+            const char *nl = memrchr(history.map, '\n', start - 1);
+            start = nl != NULL ? nl + 1 - history.map : 0;
+        }
+    }
+    fflush(stdout);
+    write(STDOUT_FILENO, history.map + start, history.indexed - start);
+}
+
+//////////////////////////////////////////////////////////////////
+// COMMAND INDEX (executables on PATH for completion, kept fresh with inotify)
+//////////////////////////////////////////////////////////////////
+
+// every PATH directory is watched, a change only marks that directory for a rescan.
+// scans happen one directory at a time while the line editor is idle, or all at
+// once when a completion needs the index before it is done
+#define COMMAND_INDEX_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | \
+                                  IN_DELETE_SELF | IN_MOVE_SELF)
+
+typedef struct commandindexdir {
+    char *path;
+    int wd;
+    int dirty;
+    char *arena; // names, \0 separated
+    size_t arenalen;
+    int count;
+} commandindexdir;
+
+typedef struct commandindex {
+    char *path_value; // PATH the index was built for
+    commandindexdir *dirs;
+    int dircount;
+    int inotify_fd;
+    int pending; // directories waiting for a (re)scan
+    int merged_dirty;
+    const char **commands; // every command name, sorted and unique
+    int commandcount;
+} commandindex;
+
+static commandindex command_index = {.inotify_fd = -1};
+
+static const char *builtin_command_names[] = {"bg", "cd", "complete", "exit", "export", "fg", "history", "jobs",
+                                              "joblog", "ln", "rm", "submit", "unset", NULL};
+
+void stopCommandIndex() {
+    for (int i = 0; i < command_index.dircount; i++) {
+        free(command_index.dirs[i].path);
+        free(command_index.dirs[i].arena);
+    }
+    free(command_index.dirs);
+    free(command_index.commands);
+    free(command_index.path_value);
+    if (command_index.inotify_fd >= 0) close(command_index.inotify_fd);
+
+    command_index.dirs = NULL;
+    command_index.dircount = 0;
+    command_index.commands = NULL;
+    command_index.commandcount = 0;
+    command_index.path_value = NULL;
+    command_index.inotify_fd = -1;
+    command_index.pending = 0;
+}
+
+// sets up watches for every PATH directory, the scans themselves happen later
+void startCommandIndex() {
+    stopCommandIndex();
+
+    char *path = getShellVariable("PATH");
+    command_index.path_value = strdup(path != NULL ? path : "");
+    command_index.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    command_index.merged_dirty = 1;
+
+    int size = 1;
+    for (char *c = command_index.path_value; *c != '\0'; c++) size += (*c == ':');
+    command_index.dirs = calloc(size, sizeof(struct commandindexdir));
+
+    char *copy = strdup(command_index.path_value);
+    char *rest = copy;
+    char *dir;
+    while ((dir = strsep(&rest, ":")) != NULL) {
+        if (dir[0] == '\0') dir = "."; // an empty PATH entry is the current directory
+
+        int duplicate = 0;
+        for (int i = 0; i < command_index.dircount; i++) {
+            if (strcmp(command_index.dirs[i].path, dir) == 0) duplicate = 1;
+        }
+        if (duplicate) continue;
+
+        commandindexdir *d = &command_index.dirs[command_index.dircount++];
+        d->path = strdup(dir);
+        d->wd = command_index.inotify_fd >= 0 ? inotify_add_watch(command_index.inotify_fd, dir, COMMAND_INDEX_WATCH_MASK) : -1;
+        d->dirty = 1;
+        command_index.pending++;
+    }
+    free(copy);
+}
+
+void scanCommandIndexDir(commandindexdir *d) {
+    free(d->arena);
+    d->arena = NULL;
+    d->arenalen = 0;
+    d->count = 0;
+
+    int dirfd = open(d->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0) return;
+
+    char *direntbuffer = getDirentBuffer();
+    size_t arenasize = 4096;
+    d->arena = malloc(arenasize);
+
+    long nread;
+    while ((nread = syscall(SYS_getdents64, dirfd, direntbuffer, GLOB_DIRENT_BUFFER_SIZE)) > 0) {
+        for (long pos = 0; pos < nread;) {
+            struct linux_dirent64 *e = (struct linux_dirent64 *) (direntbuffer + pos);
+            pos += e->d_reclen;
+
+            if (e->d_name[0] == '.' || e->d_type == DT_DIR) continue;
+            if (faccessat(dirfd, e->d_name, X_OK, 0) < 0) continue;
+            if (e->d_type == DT_LNK || e->d_type == DT_UNKNOWN) {
+                struct stat st;
+                if (fstatat(dirfd, e->d_name, &st, 0) < 0 || S_ISDIR(st.st_mode)) continue;
+            }
+
+            size_t len = strlen(e->d_name) + 1;
+            if (d->arenalen + len > arenasize) {
+                while (d->arenalen + len > arenasize) arenasize *= 2;
+                d->arena = realloc(d->arena, arenasize);
+            }
+            memcpy(d->arena + d->arenalen, e->d_name, len);
+            d->arenalen += len;
+            d->count++;
+        }
+    }
+    close(dirfd);
+}
+
+int compareCommandNames(const void *a, const void *b) {
+    return strcmp(*(const char **) a, *(const char **) b);
+}
+
+void mergeCommandIndex() {
+    int total = 0;
+    for (int i = 0; builtin_command_names[i] != NULL; i++) total++;
+    for (int i = 0; i < command_index.dircount; i++) total += command_index.dirs[i].count;
+
+    free(command_index.commands);
+    command_index.commands = malloc((total + 1) * sizeof(char *));
+    int n = 0;
+    for (int i = 0; builtin_command_names[i] != NULL; i++) command_index.commands[n++] = builtin_command_names[i];
+    for (int i = 0; i < command_index.dircount; i++) {
+        const char *name = command_index.dirs[i].arena;
+        for (int k = 0; k < command_index.dirs[i].count; k++) {
+            command_index.commands[n++] = name;
+            name += strlen(name) + 1;
+        }
+    }
+    qsort(command_index.commands, n, sizeof(char *), compareCommandNames);
+
+    // the same name in two PATH directories only completes once
+    int unique = 0;
+    for (int i = 0; i < n; i++) {
+        if (unique == 0 || strcmp(command_index.commands[unique - 1], command_index.commands[i]) != 0) {
+            command_index.commands[unique++] = command_index.commands[i];
+        }
+    }
+    command_index.commandcount = unique;
+    command_index.merged_dirty = 0;
+}
+
+// marks directories that changed on disk for a rescan
+void readCommandIndexEvents() {
+    if (command_index.inotify_fd < 0) return;
+    char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+    while ((n = read(command_index.inotify_fd, events, sizeof(events))) > 0) {
+        for (char *p = events; p < events + n;) {
+            struct inotify_event *ev = (struct inotify_event *) p;
+            p += sizeof(struct inotify_event) + ev->len;
+            for (int i = 0; i < command_index.dircount; i++) {
+                commandindexdir *d = &command_index.dirs[i];
+                if (d->wd != ev->wd) continue;
+                if (ev->mask & IN_IGNORED) d->wd = -1;
+                if (!d->dirty) {
+                    d->dirty = 1;
+                    command_index.pending++;
+                }
+            }
+        }
+    }
+}
+
+int commandIndexPending() {
+    return command_index.pending > 0 || command_index.merged_dirty;
+}
+
+// one unit of background work, called while the line editor has nothing to do
+void commandIndexStep() {
+    for (int i = 0; i < command_index.dircount; i++) {
+        if (command_index.dirs[i].dirty) {
+            scanCommandIndexDir(&command_index.dirs[i]);
+            command_index.dirs[i].dirty = 0;
+            command_index.pending--;
+            command_index.merged_dirty = 1;
+            return;
+        }
+    }
+    if (command_index.merged_dirty) mergeCommandIndex();
+}
+
+// brings the index fully up to date, restarting it when PATH changed
+void finishCommandIndex() {
+    char *path = getShellVariable("PATH");
+    if (command_index.path_value == NULL || strcmp(command_index.path_value, path != NULL ? path : "") != 0) {
+        startCommandIndex();
+    }
+    readCommandIndexEvents();
+    while (commandIndexPending()) commandIndexStep();
+}
+
+// names starting with prefix are contiguous in a sorted array, two binary searches find
+// the range [return value, *end) without touching the matches in between
+int findPrefixRange(const char **names, int count, const char *prefix, size_t plen, int *end) {
+    int lo = 0, hi = count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (strcmp(names[mid], prefix) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    int first = lo;
+    hi = count;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        if (strncmp(names[mid], prefix, plen) == 0) lo = mid + 1;
+        else hi = mid;
+    }
+    *end = lo;
+    return first;
+}
+
+// commands starting with prefix are contiguous in the sorted index.
+// returns the number of matches, *first points at the first one
+int findCommandCompletions(const char *prefix, const char ***first) {
+    finishCommandIndex();
+    size_t plen = strlen(prefix);
+
+    int end;
+    int lo = findPrefixRange(command_index.commands, command_index.commandcount, prefix, plen, &end);
+    *first = command_index.commands + lo;
+    return end - lo;
+}
+
+// the last directory listed for file name completion, reused while its mtime is unchanged
+typedef struct completiondir {
+    char *path;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+    char *arena;
+    const char **names; // sorted, directories end with '/'
+    int count;
+} completiondir;
+
+static completiondir completion_dir;
+
+void loadCompletionDir(const char *path) {
+    struct stat st;
+    if (stat(path, &st) < 0) {
+        completion_dir.count = 0;
+        return;
+    }
+    if (completion_dir.path != NULL && strcmp(completion_dir.path, path) == 0 &&
+        completion_dir.dev == st.st_dev && completion_dir.ino == st.st_ino &&
+        completion_dir.mtime.tv_sec == st.st_mtim.tv_sec && completion_dir.mtime.tv_nsec == st.st_mtim.tv_nsec) {
+        return;
+    }
+
+    free(completion_dir.path);
+    free(completion_dir.arena);
+    free(completion_dir.names);
+    completion_dir.path = strdup(path);
+    completion_dir.dev = st.st_dev;
+    completion_dir.ino = st.st_ino;
+    completion_dir.mtime = st.st_mtim;
+    completion_dir.arena = NULL;
+    completion_dir.names = NULL;
+    completion_dir.count = 0;
+
+    int dirfd = open(path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (dirfd < 0) return;
+
+    char *direntbuffer = getDirentBuffer();
+    size_t arenasize = 4096, arenalen = 0;
+    char *arena = malloc(arenasize);
+    long nread;
+    while ((nread = syscall(SYS_getdents64, dirfd, direntbuffer, GLOB_DIRENT_BUFFER_SIZE)) > 0) {
+        for (long pos = 0; pos < nread;) {
+            struct linux_dirent64 *e = (struct linux_dirent64 *) (direntbuffer + pos);
+            pos += e->d_reclen;
+            if (strcmp(e->d_name, ".") == 0 || strcmp(e->d_name, "..") == 0) continue;
+
+            int isdir = e->d_type == DT_DIR;
+            if (e->d_type == DT_LNK || e->d_type == DT_UNKNOWN) {
+                struct stat est;
+                isdir = fstatat(dirfd, e->d_name, &est, 0) == 0 && S_ISDIR(est.st_mode);
+            }
+
+            size_t len = strlen(e->d_name);
+            if (arenalen + len + 2 > arenasize) {
+                while (arenalen + len + 2 > arenasize) arenasize *= 2;
+                arena = realloc(arena, arenasize);
+            }
+            memcpy(arena + arenalen, e->d_name, len);
+            arenalen += len;
+            if (isdir) arena[arenalen++] = '/';
+            arena[arenalen++] = '\0';
+            completion_dir.count++;
+        }
+    }
+    close(dirfd);
+
+    completion_dir.arena = arena;
+    completion_dir.names = malloc((completion_dir.count + 1) * sizeof(char *));
+    const char *name = arena;
+    for (int i = 0; i < completion_dir.count; i++) {
+        completion_dir.names[i] = name;
+        name += strlen(name) + 1;
+    }
+    qsort(completion_dir.names, completion_dir.count, sizeof(char *), compareCommandNames);
+}
+
+// file names in word's directory starting with the rest of word, same contract as
+// findCommandCompletions. *namestart is where the name part of word begins
+int findFileCompletions(const char *word, const char ***first, size_t *namestart) {
+    const char *slash = strrchr(word, '/');
+    const char *prefix = slash != NULL ? slash + 1 : word;
+    *namestart = prefix - word;
+
+    char dir[*namestart + 2];
+    if (slash == NULL) {
+        strcpy(dir, ".");
+    } else if (slash == word) {
+        strcpy(dir, "/");
+    } else {
+        memcpy(dir, word, *namestart);
+        dir[*namestart] = '\0';
+    }
+    loadCompletionDir(dir);
+
+    int end;
+    int lo = findPrefixRange(completion_dir.names, completion_dir.count, prefix, strlen(prefix), &end);
+
+    // hidden files only when asked for
+    while (prefix[0] != '.' && lo < end && completion_dir.names[lo][0] == '.') lo++;
+
+    *first = completion_dir.names + lo;
+    return end > lo ? end - lo : 0;
+}
+
+// [complete [-f] [-t] word] prints what Tab would offer for word, -f completes a file
+// name instead of a command and -t adds the lookup time in ns
+void completeBuiltin(char *arguments) {
+    int files = 0, timing = 0;
+    char args[strlen(arguments) + 1];
+    strcpy(args, arguments);
+
+    char *word = "";
+    char *saveptr;
+    for (char *arg = strtok_r(args, " ", &saveptr); arg != NULL; arg = strtok_r(NULL, " ", &saveptr)) {
+        if (strcmp(arg, "-f") == 0) files = 1;
+        else if (strcmp(arg, "-t") == 0) timing = 1;
+        else word = arg;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    const char **first;
+    size_t namestart = 0;
+    int count = files ? findFileCompletions(word, &first, &namestart) : findCommandCompletions(word, &first);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    for (int i = 0; i < count; i++) printf("%.*s%s\n", (int) namestart, word, first[i]);
+    if (timing) {
+        printf("complete_ns=%ld\n", (end.tv_sec - start.tv_sec) * 1000000000L + (end.tv_nsec - start.tv_nsec));
+    }
+    fflush(stdout);
+}
+
+//////////////////////////////////////////////////////////////////
+// LINE EDITING (raw mode input when stdin is a terminal)
+//////////////////////////////////////////////////////////////////
+
+// keys
+#define KEY_CTRL_A 1
+#define KEY_CTRL_B 2
+#define KEY_CTRL_D 4
+#define KEY_CTRL_E 5
+#define KEY_CTRL_F 6
+#define KEY_CTRL_G 7
+#define KEY_CTRL_H 8
+#define KEY_TAB 9
+#define KEY_CTRL_K 11
+#define KEY_CTRL_L 12
+#define KEY_ENTER 13
+#define KEY_CTRL_N 14
+#define KEY_CTRL_P 16
+#define KEY_CTRL_R 18
+#define KEY_CTRL_U 21
+#define KEY_CTRL_W 23
+#define KEY_ESC 27
+#define KEY_BACKSPACE 127
+
+// returned by readEditorKey besides plain bytes
+#define EDITOR_EOF (-1)
+#define EDITOR_INTERRUPTED (-2)
+#define EDITOR_KEY_UP (-10)
+#define EDITOR_KEY_DOWN (-11)
+#define EDITOR_KEY_RIGHT (-12)
+#define EDITOR_KEY_LEFT (-13)
+#define EDITOR_KEY_HOME (-14)
+#define EDITOR_KEY_END (-15)
+#define EDITOR_KEY_DELETE (-16)
+#define EDITOR_REDRAW (-17) // queued jobs started and printed over the line
+#define EDITOR_NO_BYTE (-18) // an escape sequence ended early
+
+// the rest of an escape sequence comes right behind the ESC, a lone ESC gets nothing within this time
+#define EDITOR_ESCAPE_TIMEOUT_MS 50
+
+// how often queued jobs are retried while nothing else happens
+#define JOB_QUEUE_POLL_MS 100
+
+int admitQueuedJobs();
+int queuedJobCount();
+
+typedef struct lineeditor {
+    char buf[EDITOR_LINE_SIZE];
+    int len;
+    int pos;
+    int tabs; // consecutive Tab presses, the second one lists the matches
+    size_t history_pos; // entry shown by up/down, history.indexed when typing a new line
+    uint64_t history_truncations; // history.truncations when history_pos was taken
+    char saved[EDITOR_LINE_SIZE]; // the new line while walking history
+} lineeditor;
+
+// waits for the next byte from the terminal, doing command index work while idle
+int readEditorByte() {
+    while (1) {
+        struct pollfd fds[2];
+        int nfds = 1;
+        fds[0].fd = STDIN_FILENO;
+        fds[0].events = POLLIN;
+        if (command_index.inotify_fd >= 0) {
+            fds[1].fd = command_index.inotify_fd;
+            fds[1].events = POLLIN;
+            nfds = 2;
+        }
+
+        int timeout = commandIndexPending() ? 0 : (queuedJobCount() > 0 ? JOB_QUEUE_POLL_MS : -1);
+        int ready = pollJobLogs(fds, nfds, timeout, NULL);
+        if (ready < 0) {
+            if (errno != EINTR) return EDITOR_EOF;
+            // only Ctrl-C interrupts, a finished job (SIGCHLD) may make room for a queued one
+            if (interrupt_received) return EDITOR_INTERRUPTED;
+            if (queuedJobCount() > 0 && admitQueuedJobs() > 0) return EDITOR_REDRAW;
+            continue;
+        }
+        if (ready == 0) {
+            if (queuedJobCount() > 0 && admitQueuedJobs() > 0) return EDITOR_REDRAW;
+            commandIndexStep();
+            continue;
+        }
+        if (nfds == 2 && fds[1].revents) readCommandIndexEvents();
+        if (fds[0].revents) {
+            unsigned char c;
+            ssize_t n = read(STDIN_FILENO, &c, 1);
+            if (n == 1) return c;
+            if (n < 0 && errno == EINTR) {
+                if (interrupt_received) return EDITOR_INTERRUPTED;
+                continue;
+            }
+            return EDITOR_EOF;
+        }
+    }
+}
+
+// the next byte of an escape sequence, EDITOR_NO_BYTE when the terminal sent nothing more
+int readEscapeSequenceByte() {
+    struct pollfd in = {STDIN_FILENO, POLLIN, 0};
+    int ready;
+    while ((ready = poll(&in, 1, EDITOR_ESCAPE_TIMEOUT_MS)) < 0 && errno == EINTR && !interrupt_received);
+    if (ready < 0) return errno == EINTR ? EDITOR_INTERRUPTED : EDITOR_EOF;
+    if (ready == 0) return EDITOR_NO_BYTE;
+    return readEditorByte();
+}
+
+// reads a key, turning the usual escape sequences into EDITOR_KEY_*
+int readEditorKey() {
+    int c = readEditorByte();
+    if (c != KEY_ESC) return c;
+
+    int c1 = readEscapeSequenceByte();
+    if (c1 == EDITOR_NO_BYTE) return KEY_ESC;
+    if (c1 != '[' && c1 != 'O') return c1 < 0 ? c1 : KEY_ESC;
+    int c2 = readEscapeSequenceByte();
+    if (c2 < 0) return c2 == EDITOR_NO_BYTE ? KEY_ESC : c2;
+    switch (c2) {
+        case 'A':
+            return EDITOR_KEY_UP;
+        case 'B':
+            return EDITOR_KEY_DOWN;
+        case 'C':
+            return EDITOR_KEY_RIGHT;
+        case 'D':
+            return EDITOR_KEY_LEFT;
+        case 'H':
+            return EDITOR_KEY_HOME;
+        case 'F':
+            return EDITOR_KEY_END;
+    }
+    if (c2 >= '0' && c2 <= '9') {
+        int c3 = readEscapeSequenceByte();
+        if (c3 == EDITOR_INTERRUPTED || c3 == EDITOR_EOF) return c3;
+        if (c3 != '~') return KEY_ESC;
+        if (c2 == '1' || c2 == '7') return EDITOR_KEY_HOME;
+        if (c2 == '4' || c2 == '8') return EDITOR_KEY_END;
+        if (c2 == '3') return EDITOR_KEY_DELETE;
+    }
+    return KEY_ESC;
+}
+
+// redraws prompt and line in a single write and puts the cursor back
+void refreshEditorLine(lineeditor *le) {
+    char out[sizeof(shell_prompt) + EDITOR_LINE_SIZE + 32];
+    int n = snprintf(out, sizeof(out), "\r%s%.*s\x1b[K", shell_prompt, le->len, le->buf);
+    int column = (int) strlen(shell_prompt) + le->pos;
+    n += snprintf(out + n, sizeof(out) - n, "\r");
+    if (column > 0) n += snprintf(out + n, sizeof(out) - n, "\x1b[%dC", column);
+    write(STDOUT_FILENO, out, n);
+}
+
+void insertEditorText(lineeditor *le, const char *text, int len) {
+    if (le->len + len > EDITOR_LINE_SIZE - 2) len = EDITOR_LINE_SIZE - 2 - le->len; // room for \n\0
+    if (len <= 0) return;
+    memmove(le->buf + le->pos + len, le->buf + le->pos, le->len - le->pos);
+    memcpy(le->buf + le->pos, text, len);
+    le->len += len;
+    le->pos += len;
+}
+
+void setEditorLine(lineeditor *le, const char *text, int len) {
+    if (len > EDITOR_LINE_SIZE - 2) len = EDITOR_LINE_SIZE - 2;
+    memcpy(le->buf, text, len);
+    le->len = len;
+    le->pos = len;
+}
+
+// up/down walk the history log, the line being typed is kept aside
+void moveEditorHistory(lineeditor *le, int older) {
+    // another shell may have appended to or truncated the log since the last key
+    int at_new_line = le->history_pos == history.indexed;
+    refreshHistory();
+    if (at_new_line || le->history_truncations != history.truncations) {
+        le->history_pos = history.indexed;
+        le->history_truncations = history.truncations;
+    }
+    if (history.map == NULL) return;
+
+    if (older) {
+        if (le->history_pos == 0) return;
+        if (le->history_pos == history.indexed) {
+            memcpy(le->saved, le->buf, le->len);
+            le->saved[le->len] = '\0';
+        }
+        const char *nl = le->history_pos > 1 ? memrchr(history.map, '\n', le->history_pos - 1) : NULL;
+        le->history_pos = nl != NULL ? nl + 1 - history.map : 0;
+    } else {
+        if (le->history_pos == history.indexed) return;
+        const char *nl = memchr(history.map + le->history_pos, '\n', history.indexed - le->history_pos);
+        le->history_pos = nl + 1 - history.map;
+        if (le->history_pos == history.indexed) {
+            setEditorLine(le, le->saved, strlen(le->saved));
+            return;
+        }
+    }
+    const char *entry = history.map + le->history_pos;
+    const char *nl = memchr(entry, '\n', history.indexed - le->history_pos);
+    setEditorLine(le, entry, nl - entry);
+}
+
+// Ctrl-R, each keystroke searches the history index again.
+// returns 1 when Enter accepted the match and the line should run
+int reverseSearchHistory(lineeditor *le) {
+    char query[EDITOR_LINE_SIZE];
+    int qlen = 0;
+    long match = -1;
+    refreshHistory();
+    uint64_t truncations = history.truncations;
+
+    while (1) {
+        // a truncated log takes the match with it
+        refreshHistory();
+        if (truncations != history.truncations) {
+            truncations = history.truncations;
+            match = -1;
+        }
+
+        const char *entry = "";
+        int entrylen = 0;
+        if (match >= 0) {
+            entry = history.map + match;
+            entrylen = (const char *) memchr(entry, '\n', history.indexed - match) - entry;
+        }
+        char out[2 * EDITOR_LINE_SIZE + 64];
+        int n = snprintf(out, sizeof(out), "\r(%sreverse-i-search)`%.*s': %.*s\x1b[K",
+                         (qlen > 0 && match < 0) ? "failed " : "", qlen, query, entrylen, entry);
+        write(STDOUT_FILENO, out, n);
+
+        int key = readEditorKey();
+        if (key == EDITOR_REDRAW) continue; // queued jobs printed over the search, draw it again
+        if (key == KEY_CTRL_R) {
+            if (match >= 0) {
+                long older = findHistoryMatch(query, qlen, match);
+                if (older >= 0) match = older;
             }
+            continue;
+        }
+        if (key == KEY_BACKSPACE || key == KEY_CTRL_H) {
+            if (qlen > 0) qlen--;
+        } else if (key >= 32 && key < 127 && qlen < EDITOR_LINE_SIZE - 1) {
+            query[qlen++] = key;
         } else {
-            // handle the double symbol case [>>]
-            if (command[idx - 1] == '>' && command[next] == '>') {
-                tmpshcmd->command = malloc(2);
-                char carrots[3];
-                carrots[0] = command[idx - 1];
-                carrots[1] = command[next];
-                carrots[2] = '\0';
+            // anything else ends the search, Ctrl-G/Ctrl-C give up on it
+            if (key == KEY_CTRL_G || key == EDITOR_INTERRUPTED) {
+                interrupt_received = 0;
+                refreshEditorLine(le);
+                return 0;
+            }
+            if (match >= 0) setEditorLine(le, entry, entrylen);
+            refreshEditorLine(le);
+            return key == KEY_ENTER || key == '\n';
+        }
+        match = qlen > 0 ? findHistoryMatch(query, qlen, history.indexed) : -1;
+    }
+}
 
-                strcpy(tmpshcmd->command, carrots);
-                tmpshcmd->proceeding_special_character = DOUBLE_GREATER_THAN_SYMBOL;
-                tmpshcmd->next = (struct shellcommand *) malloc(sizeof(struct shellcommand));
-                tmpshcmd = tmpshcmd->next;
-                tmpshcmd->next = NULL;
+// prints the matches under the line, then redraws it
+void listEditorCompletions(lineeditor *le, const char **matches, int count) {
+    struct winsize ws;
+    int width = (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_col > 0) ? ws.ws_col : 80;
+    int shown = count < 200 ? count : 200;
+
+    int colwidth = 0;
+    for (int i = 0; i < shown; i++) {
+        int len = strlen(matches[i]);
+        if (len > colwidth) colwidth = len;
+    }
+    colwidth += 2;
+    int columns = width / colwidth > 0 ? width / colwidth : 1;
+
+    write(STDOUT_FILENO, "\r\n", 2);
+    for (int i = 0; i < shown; i++) {
+        int last = (i % columns == columns - 1) || i == shown - 1;
+        if (last) dprintf(STDOUT_FILENO, "%s\r\n", matches[i]);
+        else dprintf(STDOUT_FILENO, "%-*s", colwidth, matches[i]);
+    }
+    if (shown < count) dprintf(STDOUT_FILENO, "(%d more)\r\n", count - shown);
+    refreshEditorLine(le);
+}
+
+void completeEditorWord(lineeditor *le) {
+    int start = le->pos;
+    while (start > 0 && le->buf[start - 1] != ' ') start--;
+    int first_word = 1;
+    for (int i = 0; i < start; i++) {
+        if (le->buf[i] != ' ') first_word = 0;
+    }
+
+    char word[le->pos - start + 1];
+    memcpy(word, le->buf + start, le->pos - start);
+    word[le->pos - start] = '\0';
+
+    const char **matches;
+    size_t namestart = 0;
+    int commandword = first_word && strchr(word, '/') == NULL;
+    int count = commandword ? findCommandCompletions(word, &matches) : findFileCompletions(word, &matches, &namestart);
+    if (count == 0) return;
+
+    // extend the word by what every match has in common
+    const char *typed = word + namestart;
+    size_t typedlen = strlen(typed);
+    size_t common = strlen(matches[0]);
+    for (int i = 1; i < count && common > typedlen; i++) {
+        size_t k = typedlen;
+        while (k < common && matches[i][k] == matches[0][k]) k++;
+        common = k;
+    }
+
+    if (common > typedlen) {
+        insertEditorText(le, matches[0] + typedlen, common - typedlen);
+        le->tabs = 0;
+    }
+    if (count == 1) {
+        // a finished command gets a space, directories keep the / so Tab can go on
+        if (matches[0][strlen(matches[0]) - 1] != '/') insertEditorText(le, " ", 1);
+        refreshEditorLine(le);
+        return;
+    }
+    if (common == typedlen && le->tabs >= 2) {
+        listEditorCompletions(le, matches, count);
+        return;
+    }
+    refreshEditorLine(le);
+}
+
+// reads a line from the terminal with editing, history and completion.
+// same contract as dpuread: the line with its \n in command, 0 at EOF
+int lineEditorRead(char *command) {
+    struct termios original, raw;
+    if (tcgetattr(STDIN_FILENO, &original) < 0) return 0;
+    raw = original;
+    raw.c_iflag &= ~(ICRNL | IXON);
+    raw.c_lflag &= ~(ICANON | ECHO | IEXTEN); // ISIG stays so Ctrl-C/Ctrl-Z still signal
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &raw);
+
+    refreshHistory();
+    lineeditor le;
+    le.len = 0;
+    le.pos = 0;
+    le.tabs = 0;
+    le.history_pos = history.indexed;
+    le.history_truncations = history.truncations;
+    le.saved[0] = '\0';
+    interrupt_received = 0;
+
+    int done = 0, eof = 0;
+    while (!done) {
+        int key = readEditorKey();
+        le.tabs = key == KEY_TAB ? le.tabs + 1 : 0;
+
+        switch (key) {
+            case EDITOR_EOF:
+                eof = 1;
+                done = 1;
+                break;
+            case EDITOR_REDRAW:
+                refreshEditorLine(&le);
+                break;
+            case EDITOR_INTERRUPTED:
+                // Ctrl-C drops the line
+                interrupt_received = 0;
+                write(STDOUT_FILENO, "^C\r\n", 4);
+                le.len = 0;
+                le.pos = 0;
+                le.history_pos = history.indexed;
+                refreshEditorLine(&le);
+                break;
+            case KEY_ENTER:
+            case '\n':
+                done = 1;
+                break;
+            case KEY_CTRL_D:
+                if (le.len == 0) {
+                    eof = 1;
+                    done = 1;
+                } else if (le.pos < le.len) {
+                    memmove(le.buf + le.pos, le.buf + le.pos + 1, le.len - le.pos - 1);
+                    le.len--;
+                    refreshEditorLine(&le);
+                }
+                break;
+            case EDITOR_KEY_DELETE:
+                if (le.pos < le.len) {
+                    memmove(le.buf + le.pos, le.buf + le.pos + 1, le.len - le.pos - 1);
+                    le.len--;
+                    refreshEditorLine(&le);
+                }
+                break;
+            case KEY_BACKSPACE:
+            case KEY_CTRL_H:
+                if (le.pos > 0) {
+                    memmove(le.buf + le.pos - 1, le.buf + le.pos, le.len - le.pos);
+                    le.pos--;
+                    le.len--;
+                    refreshEditorLine(&le);
+                }
+                break;
+            case KEY_CTRL_A:
+            case EDITOR_KEY_HOME:
+                le.pos = 0;
+                refreshEditorLine(&le);
+                break;
+            case KEY_CTRL_E:
+            case EDITOR_KEY_END:
+                le.pos = le.len;
+                refreshEditorLine(&le);
+                break;
+            case KEY_CTRL_B:
+            case EDITOR_KEY_LEFT:
+                if (le.pos > 0) le.pos--;
+                refreshEditorLine(&le);
+                break;
+            case KEY_CTRL_F:
+            case EDITOR_KEY_RIGHT:
+                if (le.pos < le.len) le.pos++;
+                refreshEditorLine(&le);
+                break;
+            case KEY_CTRL_K:
+                le.len = le.pos;
+                refreshEditorLine(&le);
+                break;
+            case KEY_CTRL_U:
+                memmove(le.buf, le.buf + le.pos, le.len - le.pos);
+                le.len -= le.pos;
+                le.pos = 0;
+                refreshEditorLine(&le);
+                break;
+            case KEY_CTRL_W: {
+                int start = le.pos;
+                while (start > 0 && le.buf[start - 1] == ' ') start--;
+                while (start > 0 && le.buf[start - 1] != ' ') start--;
+                memmove(le.buf + start, le.buf + le.pos, le.len - le.pos);
+                le.len -= le.pos - start;
+                le.pos = start;
+                refreshEditorLine(&le);
+                break;
+            }
+            case KEY_CTRL_L:
+                write(STDOUT_FILENO, "\x1b[H\x1b[2J", 7);
+                refreshEditorLine(&le);
+                break;
+            case KEY_CTRL_P:
+            case EDITOR_KEY_UP:
+                moveEditorHistory(&le, 1);
+                refreshEditorLine(&le);
+                break;
+            case KEY_CTRL_N:
+            case EDITOR_KEY_DOWN:
+                moveEditorHistory(&le, 0);
+                refreshEditorLine(&le);
+                break;
+            case KEY_CTRL_R:
+                done = reverseSearchHistory(&le);
+                break;
+            case KEY_TAB:
+                completeEditorWord(&le);
+                break;
+            default:
+                if (key >= 32 && key != KEY_BACKSPACE) {
+                    char c = key;
+                    insertEditorText(&le, &c, 1);
+                    refreshEditorLine(&le);
+                }
+        }
+    }
+
+    tcsetattr(STDIN_FILENO, TCSADRAIN, &original);
+    if (eof) {
+        write(STDOUT_FILENO, "\n", 1);
+        return 0;
+    }
+    write(STDOUT_FILENO, "\n", 1);
+
+    memcpy(command, le.buf, le.len);
+    command[le.len] = '\n';
+    command[le.len + 1] = '\0';
+    return le.len + 1;
+}
+
+void waitForForegroundJob(int pid);
+void listQueuedJobs();
+
+//////////////////////////////////////////////////////////////////
+//  Builtin commands & Error Validation
+//////////////////////////////////////////////////////////////////
+
+// exit status of the last builtin, 1 when it failed. serve mode hands it to the client
+static int builtin_status = 0;
+
+// a line of [NAME=value] words and nothing else sets shell variables, in front of
+// a command they only go into that command's environment
+int isVariableAssignmentLine(shellcontext *shcntx) {
+    return shcntx->assignments != NULL && shcntx->shellcommand->command[0] == '\0';
+}
+
+// a line the shell runs itself instead of exec'ing. serve mode runs it in a child (exit is handled
+// by the server before this), submit refuses it since a queued job is always exec'd
+int isBuiltinCommandLine(shellcontext *shcntx) {
+    if (isVariableAssignmentLine(shcntx)) return 1;
+    for (int i = 0; builtin_command_names[i] != NULL; i++) {
+        if (strcmp(shcntx->shellcommand->base_command, builtin_command_names[i]) == 0) return 1;
+    }
+    return 0;
+}
+
+int isBuiltinShellCommand(jobsllist *jobslist, shellcontext *shcntx) {
+
+    int retVal = 0;
+    builtin_status = 0;
+
+    // built in shell command, list jobs
+    if (strcmp(shcntx->shellcommand->base_command, "jobs") == 0) {
+        listJobsListJobs(jobslist);
+        listQueuedJobs();
+        retVal = 1;
+    }
+    if (strcmp(shcntx->shellcommand->base_command, "cd") == 0) {
+        // check to make sure directory is specified within the arguements
+        if (shcntx->shellcommand->arguments != NULL || shcntx->shellcommand->arguments != '\0') {
+
+            int chdir_result;
+            if (shcntx->shellcommand->arguments[0] == '~') {
+                char *home = getShellVariable("HOME");
+                chdir_result = chdir(home != NULL ? home
+                                                  : "/"); // TODO:// handle the case where ~/dir/dir, this only takes into account cd ~
+            } else {
+                chdir_result = chdir(shcntx->shellcommand->arguments);
+            }
+
+            if (chdir_result < 0) {
+                perror("cannot change directory");
+                builtin_status = 1;
+            } else {
+                redirectCacheChangedDirectory();
+            }
+        } else {
+            printf("ERROR - Can’t cd without a file path\n");
+            builtin_status = 1;
+        }
+        retVal = 1;
+    }
+    if (strcmp(shcntx->shellcommand->base_command, "ln") == 0) {
+
+        if (shcntx->shellcommand->arguments != NULL || shcntx->shellcommand->arguments != '\0') {
+
+            // need to split the source and destination into 2 from the arguements.
+            int sitor = 0;
+            int ditor = 0;
+
+            char source[strlen(shcntx->shellcommand->arguments)];
+            char dest[strlen(shcntx->shellcommand->arguments)];
+
+            int done_with_base = 0;
+
+            for (int i = 0; i < strlen(shcntx->shellcommand->arguments); i++) {
+
+                if (!done_with_base) {
+                    // process the base command
+                    if ((shcntx->shellcommand->arguments[i] != '\0') && shcntx->shellcommand->arguments[i] != ' ') {
+                        source[sitor] = shcntx->shellcommand->arguments[i];
+                        sitor++;
+                    }
+                    if (shcntx->shellcommand->arguments[i] == ' ') {
+                        done_with_base = 1;
+                    }
+                } else {
+                    // process the arguments
+                    if ((shcntx->shellcommand->arguments[i] != '\0')) {
+                        dest[ditor] = shcntx->shellcommand->arguments[i];
+                        ditor++;
+                    }
+                }
+            }
+
+            source[sitor] = '\0';
+            dest[ditor] = '\0';
+
+            char *source_cmd = malloc(sitor + 1);
+            strcpy(source_cmd, source);
+
+            char *dest_cmd = malloc(ditor + 1);
+            strcpy(dest_cmd, dest);
+
+
+            int ln_result = link(source_cmd, dest_cmd);
+            if (ln_result < 0) {
+                perror("cannot link files: check file permissions, (source/dest) paths");
+                builtin_status = 1;
+            }
+
+        } else {
+            printf("ERROR - Can't link without source/destination\n");
+            builtin_status = 1;
+        }
+
+        // use the link command
+        retVal = 1;
+    }
+
+
+    if (strcmp(shcntx->shellcommand->base_command, "rm") == 0) {
+
+        if (shcntx->shellcommand->arguments != NULL || shcntx->shellcommand->arguments != '\0') {
+
+            invalidateRedirectCache(shcntx->shellcommand->arguments);
+            int unlink_result = unlink(shcntx->shellcommand->arguments);
+            if (unlink_result < 0) {
+                perror("cannot rm files: check file permissions, paths");
+                builtin_status = 1;
+            }
+
+        } else {
+            printf("ERROR - Can't link without source/destination\n");
+            builtin_status = 1;
+        }
+
+        // use the link command
+        retVal = 1;
+    }
+
+    if (strcmp(shcntx->shellcommand->base_command, "fg") == 0) {
+        if (shcntx->shellcommand->arguments != NULL || shcntx->shellcommand->arguments != '\0') {
+
+            // SIGCHLD may free the job, it stays blocked until the job's fields are copied
+            sigset_t chld_mask, orig_mask;
+            sigemptyset(&chld_mask);
+            sigaddset(&chld_mask, SIGCHLD);
+            sigprocmask(SIG_BLOCK, &chld_mask, &orig_mask);
+
+            jobsllist *target = NULL;
+            jobsllist *l = jobslist;
+            while (l != NULL) {
+                if ((l->job->id != 0) && (l->job->id == atoi(shcntx->shellcommand->arguments))) {
+                    l->job->state = 1;
+                    target = l;
+                }
+                l = l->next;
+            }
+
+            if (target == NULL) {
+                sigprocmask(SIG_SETMASK, &orig_mask, NULL);
+                printf("ERROR - fg: no job %s\n", shcntx->shellcommand->arguments);
+                builtin_status = 1;
+            } else {
+                // the relay takes the destinations over, they go back to the job if it stops again
+                int target_pid = target->job->pid;
+                int readpipe = target->job->readpipe;
+                outputtarget *targets = target->job->targets;
+                int target_count = target->job->target_count;
+                target->job->targets = NULL;
+                target->job->target_count = 0;
+                kill(target_pid, SIGCONT);
+                sigprocmask(SIG_SETMASK, &orig_mask, NULL);
+
+                // traps the current running process in the shell. [&] jobs write straight to the
+                // terminal, there is no pipe to relay
+                if (readpipe >= 0) {
+                    int read_result;
+                    if (targets != NULL) read_result = relayOutput(readpipe, targets, target_count);
+                    else read_result = relayOutput(readpipe, &terminal_target, 1);
+
+                    if (targets != NULL && read_result != 0) {
+                        keepJobOutputTargets(jobslist, target_pid, targets, target_count);
+                        target_count = 0;
+                    }
+                }
+                if (targets != NULL) {
+                    closeOutputTargets(targets, target_count);
+                    free(targets);
+                }
+                waitForForegroundJob(target_pid);
+            }
+        }
+        retVal = 1;
+    }
+
+    if (strcmp(shcntx->shellcommand->base_command, "bg") == 0) {
+        if (shcntx->shellcommand->arguments != NULL || shcntx->shellcommand->arguments != '\0') {
+
+
+            jobsllist *l = jobslist;
+            while (l != NULL) {
+                if ((l->job->id != 0) && (l->job->id == atoi(shcntx->shellcommand->arguments))) {
+                    l->job->state = 1;
+                    // continue the background jobs
+                    l->job->state = 2;
+                    kill(l->job->pid, SIGCONT);
+                }
+                l = l->next;
+            }
+        }
+        retVal = 1;
+    }
+
+    // [NAME=value] sets a shell variable, it is only passed to children once exported
+    if (isVariableAssignmentLine(shcntx)) {
+        for (int i = 0; shcntx->assignments[i] != NULL; i++) assignShellVariable(shcntx->assignments[i]);
+        retVal = 1;
+    }
 
+    if (strcmp(shcntx->shellcommand->base_command, "export") == 0) {
+        if (shcntx->shellcommand->arguments[0] == '\0') {
+            // list the exported variables
+            char **env = getShellEnviron();
+            for (int i = 0; env[i] != NULL; i++) printf("export %s\n", env[i]);
+        } else {
+            char args[strlen(shcntx->shellcommand->arguments) + 1];
+            strcpy(args, shcntx->shellcommand->arguments);
+            char *saveptr;
+            for (char *arg = strtok_r(args, " ", &saveptr); arg != NULL; arg = strtok_r(NULL, " ", &saveptr)) {
+                char *eq = strchr(arg, '=');
+                size_t namelen = eq != NULL ? (size_t) (eq - arg) : strlen(arg);
+                if (!isValidVariableName(arg, namelen)) {
+                    printf("ERROR - export: not a valid variable name [%s]\n", arg);
+                    builtin_status = 1;
+                    continue;
+                }
+                arg[namelen] = '\0';
+                setShellVariable(arg, eq != NULL ? eq + 1 : NULL, 1);
             }
         }
+        retVal = 1;
+    }
 
+    if (strcmp(shcntx->shellcommand->base_command, "history") == 0) {
+        historyBuiltin(shcntx->shellcommand->arguments);
+        retVal = 1;
+    }
 
-        idx = next + 1;
+    if (strcmp(shcntx->shellcommand->base_command, "complete") == 0) {
+        completeBuiltin(shcntx->shellcommand->arguments);
+        retVal = 1;
     }
 
-    int triple_or_more_greater_than_symbol_errors = 0;
-    // clean up the linked list of commands
-    shellcommand *ll = c;
-    while (ll->next != NULL) {
-        // clean up >> & >>> duplicate entries
-        if ((ll->proceeding_special_character == GREATER_THAN_SYMBOL) &&
-            (ll->next->proceeding_special_character == DOUBLE_GREATER_THAN_SYMBOL)) {
-            // we have a potential case of >> or >>> n+1
-            // we need to verify that the next of the next symbol is not mis interpreted as >>
-            // this is an error case that needs to be accounted for
-            if ((ll->next->next != NULL) &&
-                (ll->next->next->proceeding_special_character == DOUBLE_GREATER_THAN_SYMBOL)) {
-                // we have hit the edge case of >>> or >> + n*(>) example: >>>>>>>>>>>
-                shellcommand *ltmp = ll->next;
-                while (ltmp->next != NULL
-                       && ltmp->next->proceeding_special_character == DOUBLE_GREATER_THAN_SYMBOL) {
-                    shellcommand *lltmp = ltmp;
-                    ltmp = ltmp->next;
-                    free(lltmp);
-                }
-                // we've by passed all of the double characters links now to clean up to indicate the error
-                ll->proceeding_special_character = DOUBLE_GREATER_THAN_SYMBOL;
-                ltmp->command[1] = '\0'; // remove the >> make >
-                ltmp->proceeding_special_character = GREATER_THAN_SYMBOL;
-                triple_or_more_greater_than_symbol_errors = 1;
+    if (strcmp(shcntx->shellcommand->base_command, "joblog") == 0) {
+        builtin_status = jobLogBuiltin(jobslist, shcntx->shellcommand->arguments);
+        retVal = 1;
+    }
 
-                if (ltmp->next != NULL) {
-                    ll->next = ltmp;
-                } else {
-                    ll->next = NULL;
-                }
+    if (strcmp(shcntx->shellcommand->base_command, "unset") == 0) {
+        char args[strlen(shcntx->shellcommand->arguments) + 1];
+        strcpy(args, shcntx->shellcommand->arguments);
+        char *saveptr;
+        for (char *arg = strtok_r(args, " ", &saveptr); arg != NULL; arg = strtok_r(NULL, " ", &saveptr)) {
+            unsetShellVariable(arg);
+        }
+        retVal = 1;
+    }
 
-            } else {
-                // we have hit the >> case and need to clean up the mis-interpretation
-                shellcommand *ltmp = ll->next;
-                ll->proceeding_special_character = DOUBLE_GREATER_THAN_SYMBOL;
-                // skip the >> link and go to the next command
-                if (ll->next->next != NULL) {
-                    ll->next = ltmp->next;
-                    free(ltmp);
-                } else {
-                    ll->next = NULL;
-                }
-                // keep the correct count for the input redirects
-                greater_than_count = greater_than_count - 2;
+    return retVal;
+}
+
+const int TOO_MANY_INPUT_REDIRECTS_IN_1_LINE = 1000;
+const int NO_REDIRECTION_FILE_SPECIFIED = 2000;
+const int TRIPLE_OR_MORE_GREATER_THAN_SYMBOLS = 3000;
+const int NO_COMMAND = 4000;
+
+int shellCommandErrorsExist(shellcontext *shellcontext) {
+    int response = 0;
+
+    // check if >>> or more exist in a line
+    if (shellcontext->triple_or_more_greater_than_symbol_errors) {
+        response = TRIPLE_OR_MORE_GREATER_THAN_SYMBOLS;
+    }
+
+    // check for too many redirects, a here-document counts as an input redirect
+    if ((response == 0) && (shellcontext->less_than_count + (shellcontext->heredoc_fd >= 0) > 1)) {
+
+        response = TOO_MANY_INPUT_REDIRECTS_IN_1_LINE;
+    }
+
+    // check for valid input file
+    shellcommand *l = shellcontext->shellcommand;
+    while ((response == 0) && (l->next != NULL)) {
+        // check for redirect
+        if ((l->proceeding_special_character == LESS_THAN_SYMBOL) &&
+            (l->next != NULL)) {
+            // check for valid input not ""
+            if (l->next->command == '\0') {
+                response = NO_REDIRECTION_FILE_SPECIFIED;
             }
         }
+        l = l->next;
+    }
 
+    // check for valid command
+    shellcommand *ll = shellcontext->shellcommand;
+    while ((response == 0) && (ll->next != NULL)) {
+        if ((ll->proceeding_special_character == GREATER_THAN_SYMBOL) &&
+            (ll->command[0] == '\0')) {
+            // ERROR ERROR - No command.
+            response = NO_COMMAND;
+        }
         ll = ll->next;
     }
+    return response;
+}
 
-    shellcommand *lll = c;
-    // get the arguments from the context
-    while (lll->next != NULL) {
-        if (lll->command != NULL && lll->command[0] != '\0') {
+// the message for a shellCommandErrorsExist code, NULL when there is no error
+const char *shellCommandErrorMessage(int error) {
+    switch (error) {
+        case 1000: //TOO_MANY_INPUT_REDIRECTS_IN_1_LINE
+            return "ERROR - Can’t have two input redirects on one line";
+        case 2000: // NO_REDIRECTION_FILE_SPECIFIED
+            return "ERROR - No redirection file specified";
+        case 3000: // TRIPLE_OR_MORE_GREATER_THAN_SYMBOLS
+            return "ERROR - Cannot have >>> or more [>]";
+        case 4000: // NO_COMMAND
+            return "ERROR - No command";
+    }
+    return NULL;
+}
 
-            int bitor = 0;
-            int aitor = 0;
+static jobsllist shelljobs[1];
 
-            char base_command[strlen(lll->command)];
-            char arguments[strlen(lll->command)];
+void noteServedCommandExit(pid_t pid, int status);
 
-            int done_with_base = 0;
+// handles signals to control background and foreground jobs
+void signal_handler(int action) {
 
-            for (int i = 0; i < strlen(lll->command); i++) {
+    if (action == SIGCHLD) {
+        pid_t pid;
+        int status;
+        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+            removeJobFromJobsListByPID(shelljobs, pid);
+            noteServedCommandExit(pid, status);
+        }
+    }
 
-                if (!done_with_base) {
-                    // process the base command
-                    if ((lll->command[i] != '\0') && lll->command[i] != ' ') {
-                        base_command[bitor] = lll->command[i];
-                        bitor++;
-                    }
-                    if (lll->command[i] == ' ') {
-                        done_with_base = 1;
-                    }
-                } else {
-                    // process the arguments
-                    if ((lll->command[i] != '\0' && lll->command[i] != '\n')) {
-                        arguments[aitor] = lll->command[i];
-                        aitor++;
-                    }
-                }
+    if (action == SIGTSTP) { // burned 2hr on SIGTSTP v. SIGSTOP
+        stop_received = 1;
+        jobsllist *l = shelljobs;
+        while (l != NULL) {
+            if ((l->job->id != 0) && (l->job->state == RUNNING_FOREGROUND)) {
+                l->job->state = STOPPED_BACKGROUND;
+                kill(l->job->pid, SIGSTOP);
+            }
+            l = l->next;
+        }
+    }
+
+    if (action == SIGINT) {
+        interrupt_received = 1;
+        jobsllist *l = shelljobs;
+        while (l != NULL) {
+            if ((l->job->id != 0) && (l->job->state == RUNNING_FOREGROUND)) {
+                // JOB STATE WILL BE HANDLED WHEN SIGCHLD IS CALLED ON KILL
+                kill(l->job->pid, SIGCONT);
             }
+            l = l->next;
+        }
+    }
+}
 
-            base_command[bitor] = '\0';
-            arguments[aitor] = '\0';
+// blocks until a foreground job is reaped by SIGCHLD or stopped by SIGTSTP.
+// the relay sees EOF as soon as a redirected child drops the pipe, so without this
+// the next command could start before a [> file] job has finished writing
+void waitForForegroundJob(int pid) {
+    sigset_t chld_mask, orig_mask;
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld_mask, &orig_mask);
+
+    job *j;
+    while ((j = findJobByPID(shelljobs, pid)) != NULL && j->state == RUNNING_FOREGROUND) {
+        pollJobLogs(NULL, 0, -1, &orig_mask); // sigsuspend that keeps the job logs moving
+    }
+    sigprocmask(SIG_SETMASK, &orig_mask, NULL);
+}
+
+// no setpriority/ioprio_set for the job, it runs like the shell
+#define NO_JOB_PRIORITY (-100)
+
+// launchCommand didn't start the job, the reason went to the job's output
+#define LAUNCH_REFUSED (-2)
+
+void applyJobPriority(int priority);
+
+// tells the user why launchCommand won't start a line, in the job's output when it has one
+void reportLaunchRefusal(int output_fd, const char *message) {
+    if (output_fd >= 0) write(output_fd, message, strlen(message));
+    else {
+        printf("%s", message);
+        fflush(stdout);
+    }
+}
 
-            c->base_command = malloc(bitor + 1);
-            strcpy(c->base_command, base_command);
+// forks and execs a parsed command line. foreground jobs are relayed and waited for,
+// background jobs ([&], the job queue, serve mode) return right away and write to output_fd,
+// or the shell's stdout when it is -1. returns the job's pid, 0 if the fork failed, -1
+// when the shell can't create pipes anymore and LAUNCH_REFUSED for a line that can't run that way
+int launchCommand(shellcontext *shcntx, char *command, int background, int priority, int output_fd) {
+    // create pipes for inter process comm.
+    int stdinPipe[2];
+    int stdoutPipe[2];
+
+    int child_pid;
+    static char processOutput; // jobs keep its address for fg, it has to outlive this call
+
+    // with several destinations the parent copies the output, nothing is left to copy it for a background job
+    int fanout = hasOutputFanout(shcntx);
+    if (fanout && background) {
+        reportLaunchRefusal(output_fd, "ERROR - tee and several output redirects need a foreground job\n");
+        return LAUNCH_REFUSED;
+    }
 
-            c->arguments = malloc(aitor + 1);
-            strcpy(c->arguments, arguments);
+    // [>>] targets come from the redirection cache, opened in the parent. the child would
+    // have nothing to write to, so the line doesn't start when the file can't be opened
+    int append_fd = -1;
+    if (!fanout && shcntx->shellcommand->next != NULL &&
+        shcntx->shellcommand->proceeding_special_character == DOUBLE_GREATER_THAN_SYMBOL) {
+        append_fd = getAppendRedirectFd(shcntx->shellcommand->next->command);
+        if (append_fd < 0) {
+            char message[MAX_READ_SIZE];
+            snprintf(message, sizeof(message), "cannot open redirection file %s: %s\n",
+                     shcntx->shellcommand->next->command, strerror(errno));
+            reportLaunchRefusal(output_fd, message);
+            return LAUNCH_REFUSED;
         }
-        lll = lll->next;
     }
 
-    shellcontext *sc = (struct shellcontext *) malloc(sizeof(struct shellcontext));
-    sc->greater_than_count = greater_than_count;
-    sc->less_than_count = less_than_count;
-    sc->triple_or_more_greater_than_symbol_errors = triple_or_more_greater_than_symbol_errors;
-    sc->shellcommand = c;
+    if (pipe(stdinPipe) < 0) {
+        perror("error creating stdin pipe");
+        return -1;
+    }
+    if (pipe(stdoutPipe) < 0) {
+        close(stdinPipe[PIPE_READ]);
+        close(stdinPipe[PIPE_WRITE]);
+        perror("error creating stdout pipe");
+        return -1;
+    }
 
-    return sc;
 
+    outputtarget targets[MAX_OUTPUT_TARGETS];
+    int target_count = fanout ? openOutputTargets(shcntx, targets) : 0;
+
+    // a relayed job gets a large pipe, fewer and larger splices
+    if (!background) fcntl(stdoutPipe[PIPE_WRITE], F_SETPIPE_SZ, RELAY_PIPE_SIZE);
+
+    // with DPUSHELL_JOBLOG_DIR a background job writes into a pipe the shell drains into its log
+    int announce = background && output_fd < 0;
+    int logpipe[2] = {-1, -1};
+    if (background && output_fd < 0 && jobLoggingEnabled() && pipe2(logpipe, O_CLOEXEC) == 0) {
+        output_fd = logpipe[PIPE_WRITE];
+    }
+
+    // prebuilt envp, only rebuilt when an exported variable changed
+    char **child_environ = getShellEnviron();
+
+    // split and glob the arguments here so a large directory is read once per
+    // command and the child only has to exec
+    char **child_argv = shcntx->glob_in_child ? NULL : buildCommandArgv(shcntx->shellcommand->command);
+
+    // SIGCHLD edits the jobs list, hold it until the job is linked in so a
+    // child that exits right away isn't reaped before it has a job
+    sigset_t chld_mask, orig_mask;
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld_mask, &orig_mask);
+
+    // affinity for the job when DPUSHELL_PLACEMENT is set, chosen against the live jobs
+    cpu_set_t placement_mask;
+    int placement_cpu, placement_node;
+    int placed = chooseJobPlacement(shelljobs, &placement_mask, &placement_cpu, &placement_node);
+
+    child_pid = fork();
+    if (0 == child_pid) { //child
+        sigprocmask(SIG_UNBLOCK, &chld_mask, NULL);
+
+        // pinned before exec so the job never runs (or allocates) anywhere else
+        if (placed && sched_setaffinity(0, sizeof(placement_mask), &placement_mask) < 0) {
+            perror("cannot set job affinity");
+        }
+        if (priority != NO_JOB_PRIORITY) applyJobPriority(priority);
+
+        // bypass stdinlogic check
+        int bypassStdinLogicCheck = 0;
+        // logic for dealing with redirects
+
+        if ((shcntx->shellcommand->next != NULL) &&
+            (shcntx->shellcommand->proceeding_special_character == GREATER_THAN_SYMBOL) &&
+            (shcntx->shellcommand->next->next != NULL) &&
+            (shcntx->shellcommand->next->proceeding_special_character == LESS_THAN_SYMBOL)) {
+            // handle the [  sort>out.txt<file.txt ] edge case
+
+            int fin = open(shcntx->shellcommand->next->next->command, O_RDONLY);
+            if (fin < 0) {
+                perror(shcntx->shellcommand->next->next->command);
+                _exit(1);
+            }
+            if (dup2(fin, STDIN_FILENO) == -1) _exit(1);
+            close(fin);
+            // output file is set below
+            bypassStdinLogicCheck = 1;
+        }
+
+        if (!bypassStdinLogicCheck){
+            if ((shcntx->shellcommand->next != NULL) &&
+                (shcntx->shellcommand->proceeding_special_character == LESS_THAN_SYMBOL)) {
+                int fin = open(shcntx->shellcommand->next->command, O_RDONLY);
+                if (fin < 0) {
+                    perror(shcntx->shellcommand->next->command);
+                    _exit(1);
+                }
+                if (dup2(fin, STDIN_FILENO) == -1) _exit(1);
+                close(fin);
+            } else if (shcntx->heredoc_fd >= 0) {
+                if (dup2(shcntx->heredoc_fd, STDIN_FILENO) == -1) _exit(1);
+            } else {
+                if (dup2(stdinPipe[PIPE_READ], STDIN_FILENO) == -1) _exit(1);
+            }
+        }
+
+        // handle the [command > file.txt] case, a fanout writes into the pipe for the parent to copy
+        if (!fanout && shcntx->shellcommand->next != NULL &&
+            shcntx->shellcommand->proceeding_special_character ==
+            GREATER_THAN_SYMBOL) { // write/overrwrite file
+
+            // open up a file with the correct permissions
+            int fout = open(shcntx->shellcommand->next->command, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+            if (fout < 0) {
+                perror(shcntx->shellcommand->next->command);
+                _exit(1);
+            }
+            if (dup2(fout, STDOUT_FILENO) == -1) _exit(1);
+            if (dup2(fout, STDERR_FILENO) == -1) _exit(1);
+            close(fout);
+        } else if (!fanout && shcntx->shellcommand->next != NULL &&
+                   shcntx->shellcommand->proceeding_special_character ==
+                   DOUBLE_GREATER_THAN_SYMBOL) { // append to file
+            // the append fd is shared with the parent's cache, don't close it
+            if (dup2(append_fd, STDOUT_FILENO) == -1) _exit(1);
+            if (dup2(append_fd, STDERR_FILENO) == -1) _exit(1);
+        } else if (background && output_fd >= 0) {
+            if (dup2(output_fd, STDOUT_FILENO) == -1) _exit(1);
+            if (dup2(output_fd, STDERR_FILENO) == -1) _exit(1);
+        } else if (!background) { // write to stdout, background jobs keep the shell's stdout
+            if (dup2(stdoutPipe[PIPE_WRITE], STDOUT_FILENO) == -1) _exit(1);
+            if (dup2(stdoutPipe[PIPE_WRITE], STDERR_FILENO) == -1) _exit(1);
+        }
+
+        // close the parent pipes
+        close(stdinPipe[PIPE_READ]);
+        close(stdinPipe[PIPE_WRITE]);
+        close(stdoutPipe[PIPE_READ]);
+        close(stdoutPipe[PIPE_WRITE]);
+
+        if (child_argv == NULL) child_argv = buildCommandArgv(shcntx->shellcommand->command);
+        environ = child_environ; // execvp searches the shell's PATH, not the inherited one
+        for (int i = 0; shcntx->assignments != NULL && shcntx->assignments[i] != NULL; i++) {
+            putenv(shcntx->assignments[i]);
+        }
+        execvp(child_argv[0], child_argv);
+
+        // the same statuses as a failed exec in $(...): 127 not found, 126 found but not runnable
+        int exec_errno = errno;
+        perror(child_argv[0]);
+        _exit(exec_errno == ENOENT ? 127 : 126);
+    }
+    free(child_argv);
+
+    if (child_pid > 0 && background) {
+        // nothing is relayed, the job reads EOF and writes to the shell's stdout
+        close(stdinPipe[PIPE_READ]);
+        close(stdinPipe[PIPE_WRITE]);
+        close(stdoutPipe[PIPE_READ]);
+        close(stdoutPipe[PIPE_WRITE]);
+
+        job *newjob = createJob(child_pid, &processOutput, -1, RUNNING_BACKGROUND, command);
+        newjob->cpu = placement_cpu;
+        newjob->node = placement_node;
+        addJobsListJob(shelljobs, newjob);
+        if (logpipe[PIPE_READ] >= 0) {
+            close(logpipe[PIPE_WRITE]);
+            newjob->log_path = startJobLog(child_pid, logpipe[PIPE_READ]);
+        }
+        if (announce) {
+            printf("[%i] %i\n", newjob->id, child_pid);
+            fflush(stdout);
+        }
+        sigprocmask(SIG_SETMASK, &orig_mask, NULL);
+    } else if (child_pid > 0) {
+        // close unused file descriptors, these are for child only
+        close(stdinPipe[PIPE_READ]);
+        close(stdoutPipe[PIPE_WRITE]);
+
+        // create job, store the process output address to read it
+        // this allows us to support bg/fg jobs
+        job *newjob = createJob(child_pid, &processOutput, stdoutPipe[PIPE_READ], RUNNING_FOREGROUND, command);
+        newjob->cpu = placement_cpu;
+        newjob->node = placement_node;
+        addJobsListJob(shelljobs, newjob);
+        sigprocmask(SIG_SETMASK, &orig_mask, NULL);
+
+        // the job may be freed by SIGCHLD while relaying, only use locals from here
+        int read_result;
+        if (fanout) read_result = relayOutput(stdoutPipe[PIPE_READ], targets, target_count);
+        else read_result = relayOutput(stdoutPipe[PIPE_READ], &terminal_target, 1);
+
+        // EOF means the child is done with its pipes, a stopped job keeps them (and the
+        // fanout's files) for fg
+        if (read_result == 0) {
+            close(stdoutPipe[PIPE_READ]);
+            close(stdinPipe[PIPE_WRITE]);
+        } else if (target_count > 0) {
+            keepJobOutputTargets(shelljobs, child_pid, targets, target_count);
+            target_count = 0;
+        }
+        waitForForegroundJob(child_pid);
+    } else {
+        sigprocmask(SIG_SETMASK, &orig_mask, NULL);
+        perror("cannot fork");
+        if (logpipe[PIPE_READ] >= 0) {
+            close(logpipe[PIPE_READ]);
+            close(logpipe[PIPE_WRITE]);
+        }
+        close(stdinPipe[PIPE_READ]);
+        close(stdinPipe[PIPE_WRITE]);
+        close(stdoutPipe[PIPE_READ]);
+        close(stdoutPipe[PIPE_WRITE]);
+    }
+    closeOutputTargets(targets, target_count);
+    return child_pid > 0 ? child_pid : 0;
+}
+
+void freeShellContext(shellcontext *shcntx) {
+    shellcommand *t = shcntx->shellcommand->next;
+    while (t != NULL) {
+        shellcommand *i = t->next;
+        free(t);
+        t = i;
+    }
+    free(shcntx->tee_arguments);
+    if (shcntx->assignments != NULL) freeCommandWords(shcntx->assignments);
+    free(shcntx);
 }
 
 //////////////////////////////////////////////////////////////////
-//  Builtin commands & Error Validation
+// JOB QUEUE ([submit] jobs wait here until the host has room for them)
 //////////////////////////////////////////////////////////////////
 
-int isBuiltinShellCommand(jobsllist *jobslist, shellcontext *shcntx) {
+// a submitted job starts once all of these hold, each can be changed with a shell variable:
+//   running jobs < DPUSHELL_MAX_JOBS (default: online cpus)
+//   1 minute load average < DPUSHELL_MAX_LOAD (default: 2 x online cpus)
+//   MemAvailable >= DPUSHELL_MIN_MEM_MB (default: 256)
+// admission is checked after each submit, before each prompt, every 100ms while the line
+// editor waits for a key (JOB_QUEUE_POLL_MS) and, once input ends, until the queue is empty.
+// at the end of input, jobs still waiting after DPUSHELL_QUEUE_TIMEOUT seconds (default 60) start anyway
+
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_IDLE 3
+#define IOPRIO_WHO_PROCESS 1
+
+typedef struct queuedjob {
+    int ticket; // submission order, shown as Q<ticket> and breaks ties between equal priorities
+    int priority; // nice value, lower starts first
+    char *command;
+} queuedjob;
+
+// binary min-heap on (priority, ticket)
+typedef struct jobqueue {
+    queuedjob *heap;
+    int count;
+    int size;
+    int next_ticket;
+    int loadavg_fd; // /proc files stay open, each check is a pread
+    int meminfo_fd;
+} jobqueue;
+
+static jobqueue job_queue = {.loadavg_fd = -1, .meminfo_fd = -1};
+
+int queuedJobBefore(queuedjob *a, queuedjob *b) {
+    if (a->priority != b->priority) return a->priority < b->priority;
+    return a->ticket < b->ticket;
+}
 
-    int retVal = 0;
+void pushQueuedJob(queuedjob j) {
+    if (job_queue.count == job_queue.size) {
+        job_queue.size = job_queue.size ? job_queue.size * 2 : 16;
+        job_queue.heap = realloc(job_queue.heap, job_queue.size * sizeof(struct queuedjob));
+    }
+    int i = job_queue.count++;
+    while (i > 0 && queuedJobBefore(&j, &job_queue.heap[(i - 1) / 2])) {
+        job_queue.heap[i] = job_queue.heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    job_queue.heap[i] = j;
+}
 
-    // built in shell command, list jobs
-    if (strcmp(shcntx->shellcommand->base_command, "jobs") == 0) {
-        listJobsListJobs(jobslist);
-        retVal = 1;
+queuedjob popQueuedJob() {
+    queuedjob top = job_queue.heap[0];
+    queuedjob last = job_queue.heap[--job_queue.count];
+    int i = 0;
+    while (1) {
+        int child = 2 * i + 1;
+        if (child >= job_queue.count) break;
+        if (child + 1 < job_queue.count && queuedJobBefore(&job_queue.heap[child + 1], &job_queue.heap[child])) child++;
+        if (!queuedJobBefore(&job_queue.heap[child], &last)) break;
+        job_queue.heap[i] = job_queue.heap[child];
+        i = child;
     }
-    if (strcmp(shcntx->shellcommand->base_command, "cd") == 0) {
-        // check to make sure directory is specified within the arguements
-        if (shcntx->shellcommand->arguments != NULL || shcntx->shellcommand->arguments != '\0') {
+    if (job_queue.count > 0) job_queue.heap[i] = last;
+    return top;
+}
 
-            int chdir_result;
-            if (shcntx->shellcommand->arguments[0] == '~') {
-                chdir_result = chdir(
-                        getenv("HOME")); // TODO:// handle the case where ~/dir/dir, this only takes into account cd ~
-            } else {
-                chdir_result = chdir(shcntx->shellcommand->arguments);
-            }
+int queuedJobCount() {
+    return job_queue.count;
+}
 
-            if (chdir_result < 0) perror("cannot change directory");
-        } else {
-            printf("ERROR - Can’t cd without a file path\n");
-        }
-        retVal = 1;
+int compareQueuedJobs(const void *a, const void *b) {
+    return queuedJobBefore((queuedjob *) a, (queuedjob *) b) ? -1 : 1;
+}
+
+// part of [jobs], in the order the jobs will start
+void listQueuedJobs() {
+    queuedjob sorted[job_queue.count + 1];
+    memcpy(sorted, job_queue.heap, job_queue.count * sizeof(struct queuedjob));
+    qsort(sorted, job_queue.count, sizeof(struct queuedjob), compareQueuedJobs);
+    for (int i = 0; i < job_queue.count; i++) {
+        printf("[Q%i]\t[-]\t[QUEUED]\t[%s]\t[prio %i]\n", sorted[i].ticket, sorted[i].command, sorted[i].priority);
     }
-    if (strcmp(shcntx->shellcommand->base_command, "ln") == 0) {
+}
 
-        if (shcntx->shellcommand->arguments != NULL || shcntx->shellcommand->arguments != '\0') {
+// a shell variable as a number, fallback when it is unset or not a number
+double getQueueThreshold(const char *name, double fallback) {
+    char *value = getShellVariable(name);
+    if (value == NULL) return fallback;
+    char *end;
+    double d = strtod(value, &end);
+    return (end == value) ? fallback : d;
+}
+
+// reads a whole /proc file through an fd kept open across calls
+ssize_t readProcFile(int *fd, const char *path, char *buf, size_t size) {
+    if (*fd < 0) *fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (*fd < 0) return -1;
+    ssize_t n = pread(*fd, buf, size - 1, 0);
+    if (n < 0) return -1;
+    buf[n] = '\0';
+    return n;
+}
+
+int jobAdmissible() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (cpus < 1) cpus = 1;
+
+    int running = 0;
+    for (jobsllist *l = shelljobs; l != NULL; l = l->next) {
+        if (l->job != NULL && l->job->id != 0 && l->job->state != STOPPED_BACKGROUND) running++;
+    }
+    if (running >= getQueueThreshold("DPUSHELL_MAX_JOBS", cpus)) return 0;
+
+    char buf[4096];
+    if (readProcFile(&job_queue.loadavg_fd, "/proc/loadavg", buf, sizeof(buf)) > 0) {
+        if (strtod(buf, NULL) >= getQueueThreshold("DPUSHELL_MAX_LOAD", 2.0 * cpus)) return 0;
+    }
+    if (readProcFile(&job_queue.meminfo_fd, "/proc/meminfo", buf, sizeof(buf)) > 0) {
+        char *available = strstr(buf, "MemAvailable:");
+        if (available != NULL) {
+            double available_mb = strtod(available + strlen("MemAvailable:"), NULL) / 1024; // kB in meminfo
+            if (available_mb < getQueueThreshold("DPUSHELL_MIN_MEM_MB", 256)) return 0;
+        }
+    }
+    return 1;
+}
 
-            // need to split the source and destination into 2 from the arguements.
-            int sitor = 0;
-            int ditor = 0;
+// runs in the child before exec. the nice value also picks the I/O class:
+// below 15 best-effort with the level the kernel would derive from nice, 15 and up idle
+void applyJobPriority(int priority) {
+    if (setpriority(PRIO_PROCESS, 0, priority) < 0) perror("cannot set job priority");
 
-            char source[strlen(shcntx->shellcommand->arguments)];
-            char dest[strlen(shcntx->shellcommand->arguments)];
+    int ioprio;
+    if (priority >= 15) ioprio = IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT;
+    else ioprio = (IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT) | ((priority + 20) / 5);
+    if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioprio) < 0) perror("cannot set job I/O priority");
+}
 
-            int done_with_base = 0;
+// launches a job taken off the queue, returns 1 if it started
+int startQueuedJob(queuedjob j) {
+    int started = 0;
+    shellcontext *shcntx = processCommand(j.command);
+    shcntx->heredoc_fd = -1;
+    if (shellCommandErrorsExist(shcntx) == 0) {
+        launchCommand(shcntx, j.command, 1, j.priority, -1);
+        started = 1;
+    } else {
+        printf("ERROR - cannot start queued job [%s]\n", j.command);
+    }
+    freeShellContext(shcntx);
+    free(j.command);
+    return started;
+}
 
-            for (int i = 0; i < strlen(shcntx->shellcommand->arguments); i++) {
+// starts queued jobs while there is room, returns how many were started
+int admitQueuedJobs() {
+    int started = 0;
+    sigset_t chld_mask, orig_mask;
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+
+    while (job_queue.count > 0) {
+        // SIGCHLD holds off while the running jobs are counted
+        sigprocmask(SIG_BLOCK, &chld_mask, &orig_mask);
+        int admissible = jobAdmissible();
+        sigprocmask(SIG_SETMASK, &orig_mask, NULL);
+        if (!admissible) break;
+
+        started += startQueuedJob(popQueuedJob());
+    }
+    return started;
+}
 
-                if (!done_with_base) {
-                    // process the base command
-                    if ((shcntx->shellcommand->arguments[i] != '\0') && shcntx->shellcommand->arguments[i] != ' ') {
-                        source[sitor] = shcntx->shellcommand->arguments[i];
-                        sitor++;
-                    }
-                    if (shcntx->shellcommand->arguments[i] == ' ') {
-                        done_with_base = 1;
-                    }
-                } else {
-                    // process the arguments
-                    if ((shcntx->shellcommand->arguments[i] != '\0')) {
-                        dest[ditor] = shcntx->shellcommand->arguments[i];
-                        ditor++;
-                    }
-                }
-            }
+// a $ in an expanded value stays literal when the line is expanded again at launch
+char *escapeExpandedCommand(const char *expanded) {
+    expansionbuffer buf;
+    buf.size = strlen(expanded) * 2 + 1;
+    buf.data = malloc(buf.size);
+    buf.len = 0;
+    buf.data[0] = '\0';
+    for (const char *p = expanded; *p != '\0'; p++) {
+        if (*p == '$') appendExpansion(&buf, "\\", 1);
+        appendExpansion(&buf, p, 1);
+    }
+    return buf.data;
+}
 
-            source[sitor] = '\0';
-            dest[ditor] = '\0';
+// [submit [-p prio] command] queues command to run in the background once admitted.
+// prio is a nice value (-20 to 19, default 0), lower starts first
+void submitJob(char *line) {
+    char *p = line;
+    while (*p == ' ') p++;
+    p += strlen("submit");
+    while (*p == ' ') p++;
+
+    int priority = 0;
+    if (strncmp(p, "-p ", 3) == 0) {
+        p += 3;
+        char *end;
+        priority = strtol(p, &end, 10);
+        if (end == p) {
+            printf("ERROR - submit: -p needs a number\n");
+            return;
+        }
+        if (priority < -20) priority = -20;
+        if (priority > 19) priority = 19;
+        p = end;
+        while (*p == ' ') p++;
+    }
+    if (*p == '\0') {
+        printf("ERROR - No command\n");
+        return;
+    }
 
-            char *source_cmd = malloc(sitor + 1);
-            strcpy(source_cmd, source);
+    // variables (and $(...)) take their values now, not when the job is admitted
+    char *expanded = expandShellVariables(p);
+    char *command = escapeExpandedCommand(expanded);
+    free(expanded);
+
+    // a queued job is exec'd in a child, a builtin would fail there or change nothing in the shell
+    shellcontext *shcntx = processCommand(command);
+    int builtin = isBuiltinCommandLine(shcntx);
+    freeShellContext(shcntx);
+    if (builtin) {
+        printf("ERROR - Builtins can't be submitted\n");
+        free(command);
+        return;
+    }
 
-            char *dest_cmd = malloc(ditor + 1);
-            strcpy(dest_cmd, dest);
+    queuedjob j;
+    j.ticket = ++job_queue.next_ticket;
+    j.priority = priority;
+    j.command = command;
+    pushQueuedJob(j);
 
+    admitQueuedJobs();
+}
 
-            int ln_result = link(source_cmd, dest_cmd);
-            if (ln_result < 0) {
-                perror("cannot link files: check file permissions, (source/dest) paths");
-            }
+// a line starting with the word submit
+int isSubmitCommand(const char *line) {
+    while (*line == ' ') line++;
+    return strncmp(line, "submit", 6) == 0 && (line[6] == ' ' || line[6] == '\0');
+}
 
-        } else {
-            printf("ERROR - Can't link without source/destination\n");
+// once input ends the shell stays until everything it accepted has started. a host that never gets
+// below the thresholds can't keep it forever, after DPUSHELL_QUEUE_TIMEOUT seconds the rest start anyway
+void drainJobQueue() {
+    struct timespec start, now;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    double timeout = getQueueThreshold("DPUSHELL_QUEUE_TIMEOUT", 60);
+
+    while (admitQueuedJobs(), job_queue.count > 0) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        if ((now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) / 1e9 >= timeout) {
+            fprintf(stderr, "starting %i queued jobs after waiting %gs for room\n", job_queue.count, timeout);
+            while (job_queue.count > 0) startQueuedJob(popQueuedJob());
+            break;
         }
+        pollJobLogs(NULL, 0, JOB_QUEUE_POLL_MS, NULL);
+    }
+}
 
-        // use the link command
-        retVal = 1;
+//////////////////////////////////////////////////////////////////
+// SERVE MODE ([DPUShell --serve SOCK] runs command lines for local clients over a UNIX socket)
+//////////////////////////////////////////////////////////////////
+
+// a client writes command lines ending in \n, as many and as early as it likes. lines from one
+// connection run one after another, connections run side by side. every line is answered with
+// frames of a 1 byte type and a 4 byte payload length (host byte order) followed by the payload:
+//   'o' output of the command (stdout and stderr)
+//   'x' the command is done, the payload is its exit status as a 4 byte int (128 + signal if killed)
+// [exit], or the client shutting down its write side, ends the connection once earlier lines are done.
+// each line runs in its own child of the server, so cd and variable changes don't carry over
+
+#define SERVE_FRAME_OUTPUT 'o'
+#define SERVE_FRAME_EXIT 'x'
+#define SERVE_FRAME_HEADER 5
+#define SERVE_READ_SIZE 65536
+#define SERVE_OUTPUT_LIMIT (1024 * 1024) // frames held for a slow client before its command has to wait
+
+typedef struct serveconnection {
+    int fd;
+    char *in; // received, not yet run
+    size_t inlen;
+    size_t insize;
+    int input_closed;
+    int closing; // [exit] was read
+    int gone; // the client went away
+    char *out; // frames not yet sent, from outpos
+    size_t outpos;
+    size_t outlen;
+    size_t outsize;
+    pid_t pid; // running command, 0 when idle, LAUNCH_REFUSED while a refused line is answered
+    int output_fd; // read end of the running command's output, -1 once it hit EOF
+    int exited; // set by SIGCHLD
+    int status;
+} serveconnection;
+
+static serveconnection *serve_connections = NULL;
+static int serve_connection_count = 0;
+static int serve_listen_fd = -1;
+
+// called by the SIGCHLD handler. the server only unblocks SIGCHLD inside ppoll, so the
+// connection array never moves underneath it
+void noteServedCommandExit(pid_t pid, int status) {
+    for (int i = 0; i < serve_connection_count; i++) {
+        if (serve_connections[i].pid == pid) {
+            serve_connections[i].exited = 1;
+            serve_connections[i].status = WIFSIGNALED(status) ? 128 + WTERMSIG(status) : WEXITSTATUS(status);
+        }
     }
+}
 
+// makes room for len more bytes of frames
+void reserveServeOutput(serveconnection *c, size_t len) {
+    if (c->outpos > 0 && c->outlen + len > c->outsize) {
+        memmove(c->out, c->out + c->outpos, c->outlen - c->outpos);
+        c->outlen -= c->outpos;
+        c->outpos = 0;
+    }
+    if (c->outlen + len > c->outsize) {
+        while (c->outlen + len > c->outsize) c->outsize = c->outsize ? c->outsize * 2 : SERVE_READ_SIZE * 2;
+        c->out = realloc(c->out, c->outsize);
+    }
+}
 
-    if (strcmp(shcntx->shellcommand->base_command, "rm") == 0) {
+void appendServeFrame(serveconnection *c, char type, const void *payload, uint32_t len) {
+    reserveServeOutput(c, SERVE_FRAME_HEADER + len);
+    c->out[c->outlen] = type;
+    memcpy(c->out + c->outlen + 1, &len, sizeof(len));
+    memcpy(c->out + c->outlen + SERVE_FRAME_HEADER, payload, len);
+    c->outlen += SERVE_FRAME_HEADER + len;
+}
 
-        if (shcntx->shellcommand->arguments != NULL || shcntx->shellcommand->arguments != '\0') {
+void finishServedCommand(serveconnection *c, int status) {
+    appendServeFrame(c, SERVE_FRAME_EXIT, &status, sizeof(status));
+    c->pid = 0;
+    c->exited = 0;
+}
 
-            int unlink_result = unlink(shcntx->shellcommand->arguments);
-            if (unlink_result < 0) {
-                perror("cannot rm files: check file permissions, paths");
-            }
+void failServedCommand(serveconnection *c, const char *message) {
+    appendServeFrame(c, SERVE_FRAME_OUTPUT, message, strlen(message));
+    appendServeFrame(c, SERVE_FRAME_OUTPUT, "\n", 1);
+    finishServedCommand(c, 2);
+}
 
-        } else {
-            printf("ERROR - Can't link without source/destination\n");
-        }
 
-        // use the link command
-        retVal = 1;
+// $(...) runs while the line is expanded, in the server loop. one slow substitution would hold up every client
+int hasCommandSubstitution(const char *line) {
+    for (const char *p = strstr(line, "$("); p != NULL; p = strstr(p + 1, "$(")) {
+        if (p == line || p[-1] != '\\') return 1;
     }
+    return 0;
+}
 
-    if (strcmp(shcntx->shellcommand->base_command, "fg") == 0) {
-        if (shcntx->shellcommand->arguments != NULL || shcntx->shellcommand->arguments != '\0') {
+// the forked copy of the server can't wait on, signal or list the server's jobs
+int isJobControlCommandLine(shellcontext *shcntx) {
+    char *base = shcntx->shellcommand->base_command;
+    if (strcmp(base, "fg") == 0 || strcmp(base, "bg") == 0 || strcmp(base, "jobs") == 0) return 1;
+    if (strcmp(base, "joblog") != 0) return 0;
+
+    char args[strlen(shcntx->shellcommand->arguments) + 1];
+    strcpy(args, shcntx->shellcommand->arguments);
+    char *saveptr;
+    for (char *arg = strtok_r(args, " ", &saveptr); arg != NULL; arg = strtok_r(NULL, " ", &saveptr)) {
+        if (strcmp(arg, "-f") == 0) return 1;
+    }
+    return 0;
+}
 
-            jobsllist *target;
-            jobsllist *l = jobslist;
-            while (l != NULL) {
-                if ((l->job->id != 0) && (l->job->id == atoi(shcntx->shellcommand->arguments))) {
-                    l->job->state = 1;
-                    target = l;
-                }
-                l = l->next;
-            }
+// a builtin's child never execs, so the server's close-on-exec fds are still open in it. a
+// child holding another client's socket or output pipe would keep that client from seeing EOF
+void closeServeFds() {
+    close(serve_listen_fd);
+    for (int i = 0; i < serve_connection_count; i++) {
+        close(serve_connections[i].fd);
+        if (serve_connections[i].output_fd >= 0) close(serve_connections[i].output_fd);
+    }
+}
 
-            // traps the current running process in the shell
-            int maxRetry = 3;
-            int currRetry = 0;
-            kill(target->job->pid, SIGCONT);
+// starts one line for the connection. external commands are launched as background jobs
+// writing into a pipe the server reads, builtins run in a child of their own
+void runServedCommand(serveconnection *c, char *line) {
+    stripBackgroundOperator(line); // everything is streamed back either way
+    while (*line == ' ') line++;
+    if (*line == '\0') {
+        finishServedCommand(c, 0);
+        return;
+    }
+    if (strcmp(line, "exit") == 0) {
+        c->closing = 1;
+        return;
+    }
 
-            while (currRetry < maxRetry) {
+    // a here-document would read its body from the server's own stdin
+    char *heredoc = findHereDocumentOperator(line);
+    if ((heredoc != NULL && heredoc[2] != '<') || isSubmitCommand(line) || hasCommandSubstitution(line)) {
+        failServedCommand(c, "ERROR - Not supported in serve mode");
+        return;
+    }
 
-                while (read(target->job->readpipe, (void *) target->job->process_stdout_read_address, 1) == 1) {
-                    write(STDOUT_FILENO, (void *) target->job->process_stdout_read_address, 1);
-                    currRetry = maxRetry;
-                }
-                currRetry++;
+    int heredoc_fd = extractHereDocument(line);
+    if (heredoc_fd == -2) {
+        failServedCommand(c, "ERROR - Bad here-string");
+        return;
+    }
+    shellcontext *shcntx = processCommand(line);
+    shcntx->heredoc_fd = heredoc_fd;
+    shcntx->glob_in_child = 1;
+
+    int output[2];
+    const char *error_message = shellCommandErrorMessage(shellCommandErrorsExist(shcntx));
+    if (error_message != NULL) {
+        failServedCommand(c, error_message);
+    } else if (isJobControlCommandLine(shcntx)) {
+        failServedCommand(c, "ERROR - Job control is not supported in serve mode");
+    } else if (pipe2(output, O_CLOEXEC) < 0) {
+        failServedCommand(c, "ERROR - Cannot create output pipe");
+    } else {
+        pid_t pid;
+        if (isBuiltinCommandLine(shcntx)) {
+            pid = fork();
+            if (pid == 0) {
+                closeServeFds();
+                close(output[PIPE_READ]);
+                dup2(output[PIPE_WRITE], STDOUT_FILENO);
+                dup2(output[PIPE_WRITE], STDERR_FILENO);
+                isBuiltinShellCommand(shelljobs, shcntx);
+                fflush(stdout);
+                _exit(builtin_status);
             }
-
+        } else {
+            pid = launchCommand(shcntx, line, 1, NO_JOB_PRIORITY, output[PIPE_WRITE]);
+        }
+        close(output[PIPE_WRITE]);
+
+        if (pid > 0) {
+            fcntl(output[PIPE_READ], F_SETFL, O_NONBLOCK);
+            c->pid = pid;
+            c->output_fd = output[PIPE_READ];
+        } else if (pid == LAUNCH_REFUSED) {
+            // the reason is in the pipe, it is sent like output and the command counts as exited
+            fcntl(output[PIPE_READ], F_SETFL, O_NONBLOCK);
+            c->pid = LAUNCH_REFUSED;
+            c->output_fd = output[PIPE_READ];
+            c->exited = 1;
+            c->status = 2;
+        } else {
+            close(output[PIPE_READ]);
+            failServedCommand(c, "ERROR - Cannot fork");
         }
-        retVal = 1;
     }
 
-    if (strcmp(shcntx->shellcommand->base_command, "bg") == 0) {
-        if (shcntx->shellcommand->arguments != NULL || shcntx->shellcommand->arguments != '\0') {
+    if (heredoc_fd >= 0) close(heredoc_fd);
+    freeShellContext(shcntx);
+}
 
+// runs the next complete line when the connection is idle
+void startServedCommands(serveconnection *c) {
+    while (c->pid == 0 && !c->closing) {
+        char *nl = memchr(c->in, '\n', c->inlen);
+        size_t linelen;
+        if (nl != NULL) linelen = nl - c->in;
+        else if (c->input_closed && c->inlen > 0) linelen = c->inlen;
+        else return;
+
+        char *line = strndup(c->in, linelen);
+        size_t consumed = nl != NULL ? linelen + 1 : linelen;
+        memmove(c->in, c->in + consumed, c->inlen - consumed);
+        c->inlen -= consumed;
+
+        runServedCommand(c, line);
+        free(line);
+    }
+}
 
-            jobsllist *l = jobslist;
-            while (l != NULL) {
-                if ((l->job->id != 0) && (l->job->id == atoi(shcntx->shellcommand->arguments))) {
-                    l->job->state = 1;
-                    // continue the background jobs
-                    l->job->state = 2;
-                    kill(l->job->pid, SIGCONT);
-                }
-                l = l->next;
-            }
+// sends what the socket takes without blocking, returns -1 once the client is gone
+int flushServeOutput(serveconnection *c) {
+    while (c->outpos < c->outlen) {
+        ssize_t n = send(c->fd, c->out + c->outpos, c->outlen - c->outpos, MSG_NOSIGNAL | MSG_DONTWAIT);
+        if (n < 0) return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
+        c->outpos += n;
+    }
+    c->outpos = 0;
+    c->outlen = 0;
+    return 0;
+}
+
+// reads what the client sent, returns -1 once the client is gone
+int readServeInput(serveconnection *c) {
+    while (1) {
+        if (c->insize - c->inlen < SERVE_READ_SIZE) {
+            c->insize = c->insize ? c->insize * 2 : SERVE_READ_SIZE * 2;
+            c->in = realloc(c->in, c->insize);
         }
-        retVal = 1;
+        ssize_t n = read(c->fd, c->in + c->inlen, c->insize - c->inlen);
+        if (n > 0) {
+            c->inlen += n;
+            continue;
+        }
+        if (n == 0) {
+            c->input_closed = 1;
+            return 0;
+        }
+        return (errno == EAGAIN || errno == EINTR) ? 0 : -1;
     }
+}
 
-    return retVal;
+// one read of the command's output straight into a frame
+void readServedOutput(serveconnection *c) {
+    reserveServeOutput(c, SERVE_FRAME_HEADER + SERVE_READ_SIZE);
+    ssize_t n = read(c->output_fd, c->out + c->outlen + SERVE_FRAME_HEADER, SERVE_READ_SIZE);
+    if (n > 0) {
+        uint32_t len = n;
+        c->out[c->outlen] = SERVE_FRAME_OUTPUT;
+        memcpy(c->out + c->outlen + 1, &len, sizeof(len));
+        c->outlen += SERVE_FRAME_HEADER + n;
+    } else if (n == 0 || (errno != EAGAIN && errno != EINTR)) {
+        close(c->output_fd);
+        c->output_fd = -1;
+    }
 }
 
-const int TOO_MANY_INPUT_REDIRECTS_IN_1_LINE = 1000;
-const int NO_REDIRECTION_FILE_SPECIFIED = 2000;
-const int TRIPLE_OR_MORE_GREATER_THAN_SYMBOLS = 3000;
-const int NO_COMMAND = 4000;
+void closeServeConnection(int i) {
+    serveconnection *c = &serve_connections[i];
+    close(c->fd);
+    if (c->output_fd >= 0) close(c->output_fd);
+    free(c->in);
+    free(c->out);
+    serve_connections[i] = serve_connections[--serve_connection_count];
+}
 
-int shellCommandErrorsExist(shellcontext *shellcontext) {
-    int response = 0;
+// never returns
+void serveCommands(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "socket path too long: %s\n", path);
+        exit(EXIT_FAILURE);
+    }
+    strcpy(addr.sun_path, path);
 
-    // check if >>> or more exist in a line
-    if (shellcontext->triple_or_more_greater_than_symbol_errors) {
-        response = TRIPLE_OR_MORE_GREATER_THAN_SYMBOLS;
+    int listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (listen_fd < 0) {
+        perror("cannot create socket");
+        exit(EXIT_FAILURE);
+    }
+    serve_listen_fd = listen_fd;
+
+    // a socket left behind by an earlier server is replaced, anything else at the path is left alone
+    struct stat st;
+    if (lstat(path, &st) == 0) {
+        if (!S_ISSOCK(st.st_mode)) {
+            fprintf(stderr, "%s exists and is not a socket\n", path);
+            exit(EXIT_FAILURE);
+        }
+        unlink(path);
+    }
+    if (bind(listen_fd, (struct sockaddr *) &addr, sizeof(addr)) < 0 || listen(listen_fd, SOMAXCONN) < 0) {
+        perror("cannot listen on socket");
+        exit(EXIT_FAILURE);
     }
 
-    // check for too many redirects
-    if ((response == 0) && (shellcontext->less_than_count > 1)) {
+    // SIGCHLD is held everywhere but inside ppoll, so exits can't slip in between a check and the wait
+    sigset_t chld_mask, orig_mask;
+    sigemptyset(&chld_mask);
+    sigaddset(&chld_mask, SIGCHLD);
+    sigprocmask(SIG_BLOCK, &chld_mask, &orig_mask);
+    sigdelset(&orig_mask, SIGCHLD);
 
-        response = TOO_MANY_INPUT_REDIRECTS_IN_1_LINE;
-    }
+    int connection_size = 0;
+    struct pollfd *fds = NULL;
 
-    // check for valid input file
-    shellcommand *l = shellcontext->shellcommand;
-    while ((response == 0) && (l->next != NULL)) {
-        // check for redirect
-        if ((l->proceeding_special_character == LESS_THAN_SYMBOL) &&
-            (l->next != NULL)) {
-            // check for valid input not ""
-            if (l->next->command == '\0') {
-                response = NO_REDIRECTION_FILE_SPECIFIED;
+    while (1) {
+        for (int i = serve_connection_count - 1; i >= 0; i--) {
+            serveconnection *c = &serve_connections[i];
+            if (c->pid != 0 && c->exited && c->output_fd < 0) finishServedCommand(c, c->status);
+            if (!c->gone) startServedCommands(c);
+            if (c->gone || flushServeOutput(c) < 0) {
+                // a command still running loses its reader and gets SIGPIPE
+                closeServeConnection(i);
+                continue;
+            }
+
+            // done once nothing runs, nothing is left to run and everything was sent
+            if (c->pid == 0 && c->outlen == 0 && (c->closing || (c->input_closed && c->inlen == 0))) {
+                closeServeConnection(i);
             }
         }
-        l = l->next;
-    }
 
-    // check for valid command
-    shellcommand *ll = shellcontext->shellcommand;
-    while ((response == 0) && (ll->next != NULL)) {
-        if ((ll->proceeding_special_character == GREATER_THAN_SYMBOL) &&
-            (ll->command[0] == '\0')) {
-            // ERROR ERROR - No command.
-            response = NO_COMMAND;
+        if (connection_size < serve_connection_count + 1) {
+            connection_size = (serve_connection_count + 1) * 2;
+            fds = realloc(fds, (1 + 2 * connection_size) * sizeof(struct pollfd));
+        }
+        fds[0].fd = listen_fd;
+        fds[0].events = POLLIN;
+        for (int i = 0; i < serve_connection_count; i++) {
+            serveconnection *c = &serve_connections[i];
+            fds[1 + 2 * i].fd = c->fd;
+            fds[1 + 2 * i].events = (c->input_closed ? 0 : POLLIN) | (c->outlen > 0 ? POLLOUT : 0);
+            // a negative fd is skipped by poll
+            fds[2 + 2 * i].fd = (c->output_fd >= 0 && c->outlen - c->outpos < SERVE_OUTPUT_LIMIT) ? c->output_fd : -1;
+            fds[2 + 2 * i].events = POLLIN;
+        }
+
+        int nfds = 1 + 2 * serve_connection_count;
+        if (ppoll(fds, nfds, NULL, &orig_mask) < 0) continue; // EINTR, a command exited
+
+        for (int i = 0; i < serve_connection_count; i++) {
+            serveconnection *c = &serve_connections[i];
+            if (fds[1 + 2 * i].revents & (POLLIN | POLLHUP | POLLERR)) {
+                if (readServeInput(c) < 0) c->gone = 1;
+            }
+            if (fds[2 + 2 * i].fd >= 0 && fds[2 + 2 * i].revents) readServedOutput(c);
+        }
+
+        if (fds[0].revents & POLLIN) {
+            int fd;
+            while ((fd = accept4(listen_fd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC)) >= 0) {
+                serve_connections = realloc(serve_connections, (serve_connection_count + 1) * sizeof(struct serveconnection));
+                serveconnection *c = &serve_connections[serve_connection_count++];
+                memset(c, 0, sizeof(struct serveconnection));
+                c->fd = fd;
+                c->output_fd = -1;
+            }
         }
-        ll = ll->next;
     }
-    return response;
 }
 
-static jobsllist shelljobs[0];
+// [DPUShell --client SOCK] sends stdin to a server and writes the commands' output to stdout.
+// exits with the status of the last command
+int runServeClient(const char *path) {
+    struct sockaddr_un addr = {.sun_family = AF_UNIX};
+    strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *) &addr, sizeof(addr)) < 0) {
+        perror("cannot connect to server");
+        return EXIT_FAILURE;
+    }
 
-// handles signals to control background and foreground jobs
-void signal_handler(int action) {
+    expansionbuffer frames = {malloc(SERVE_READ_SIZE * 2), 0, SERVE_READ_SIZE * 2};
+    char buf[SERVE_READ_SIZE];
+    int status = 0;
+    int stdin_open = 1;
 
-    if (action == SIGCHLD) {
-        pid_t pid;
-        int status;
-        while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
-            removeJobFromJobsListByPID(shelljobs, pid);
+    while (1) {
+        struct pollfd fds[2] = {{fd, POLLIN, 0}, {stdin_open ? STDIN_FILENO : -1, POLLIN, 0}};
+        if (poll(fds, 2, -1) < 0) {
+            if (errno == EINTR) continue;
+            break;
         }
-    }
 
-    if (action == SIGTSTP) { // burned 2hr on SIGTSTP v. SIGSTOP
-        jobsllist *l = shelljobs;
-        while (l != NULL) {
-            if ((l->job->id != 0) && (l->job->state == RUNNING_FOREGROUND)) {
-                l->job->state = STOPPED_BACKGROUND;
-                kill(l->job->pid, SIGSTOP);
+        if (fds[1].revents) {
+            ssize_t n = read(STDIN_FILENO, buf, sizeof(buf));
+            if (n > 0) {
+                // the server always takes input, so a blocking write can't deadlock
+                for (ssize_t done = 0; done < n;) {
+                    ssize_t w = write(fd, buf + done, n - done);
+                    if (w < 0) return EXIT_FAILURE;
+                    done += w;
+                }
+            } else {
+                stdin_open = 0;
+                shutdown(fd, SHUT_WR);
             }
-            l = l->next;
         }
-    }
 
-    if (action == SIGINT) {
-        jobsllist *l = shelljobs;
-        while (l != NULL) {
-            if ((l->job->id != 0) && (l->job->state == RUNNING_FOREGROUND)) {
-                // JOB STATE WILL BE HANDLED WHEN SIGCHLD IS CALLED ON KILL
-                kill(l->job->pid, SIGCONT);
+        if (fds[0].revents) {
+            ssize_t n = read(fd, buf, sizeof(buf));
+            if (n <= 0) break;
+            appendExpansion(&frames, buf, n);
+
+            size_t pos = 0;
+            while (frames.len - pos >= SERVE_FRAME_HEADER) {
+                uint32_t len;
+                memcpy(&len, frames.data + pos + 1, sizeof(len));
+                if (frames.len - pos < SERVE_FRAME_HEADER + len) break;
+                char *payload = frames.data + pos + SERVE_FRAME_HEADER;
+                if (frames.data[pos] == SERVE_FRAME_OUTPUT) {
+                    for (uint32_t done = 0; done < len;) {
+                        ssize_t w = write(STDOUT_FILENO, payload + done, len - done);
+                        if (w < 0) break;
+                        done += w;
+                    }
+                } else if (frames.data[pos] == SERVE_FRAME_EXIT && len == sizeof(status)) {
+                    memcpy(&status, payload, sizeof(status));
+                }
+                pos += SERVE_FRAME_HEADER + len;
             }
-            l = l->next;
+            memmove(frames.data, frames.data + pos, frames.len - pos);
+            frames.len -= pos;
         }
     }
+    close(fd);
+    return status;
 }
 
-
 int main(int argc, char **argv, char **envp) {
 
+    // [--client SOCK] only talks to a server, none of the shell is set up
+    if (argc == 3 && strcmp(argv[1], "--client") == 0) return runServeClient(argv[2]);
+    int serve = argc == 3 && strcmp(argv[1], "--serve") == 0;
+
     struct sigaction sa;
     sa.sa_handler = signal_handler;
     sa.sa_flags = 0;
@@ -762,7 +4960,11 @@ int main(int argc, char **argv, char **envp) {
         exit(EXIT_FAILURE);
     }
 
-    if (sigaction(SIGCHLD, &sa, NULL) == -1) {
+    // restart reads interrupted by a finishing child, otherwise output still
+    // sitting in the pipe is dropped by the relay loop
+    struct sigaction sachld = sa;
+    sachld.sa_flags = SA_RESTART;
+    if (sigaction(SIGCHLD, &sachld, NULL) == -1) {
         perror("Error SIGCHLD handler");
         exit(EXIT_FAILURE);
     }
@@ -772,29 +4974,48 @@ int main(int argc, char **argv, char **envp) {
         exit(EXIT_FAILURE);
     }
 
+    // the environment the shell was started with becomes its exported variables
+    initShellVariables(envp);
+
     // set the starting dir
-    chdir(getenv("HOME"));
+    if (getShellVariable("HOME") != NULL) chdir(getShellVariable("HOME"));
+
+    // served commands don't go into the history, and nobody types at a server
+    if (!serve) openHistory();
+
+    // the command index is built while the shell waits for the first keystrokes
+    if (!serve && isatty(STDIN_FILENO)) startCommandIndex();
 
     char command[MAX_READ_SIZE];
 
     // add the shell to the jobs list
     addJobsListJob(shelljobs, createJob(getpid(), NULL, -1, RUNNING_FOREGROUND, "/bin/DPUShell"));
 
+    if (serve) serveCommands(argv[2]);
+
     // start the event shell
     while (1) {
 
         /// clean buffer
         for (int i = 0; i < MAX_READ_SIZE; i++) command[i] = 0;
 
+        // queued jobs that fit now start before the next command is read
+        admitQueuedJobs();
+
 #ifndef NOPROMPT
         char cwd[1024];
         getcwd(cwd, sizeof(cwd));
-        printf("[%s]> ", cwd);
+        snprintf(shell_prompt, sizeof(shell_prompt), "[%s]> ", cwd);
+        printf("%s", shell_prompt);
         fflush(stdout);
 #endif
 
         // get user input
-        if (!dpuread(command)) return 0;
+        if (!dpuread(command)) {
+            drainJobQueue();
+            drainJobLogs();
+            return 0;
+        }
 
 
         // clean input and verify command is not nothing
@@ -802,169 +5023,59 @@ int main(int argc, char **argv, char **envp) {
 
         if (strlen(command) == 0) continue;
 
+        // only what an operator typed is kept, not scripts piped into the shell
+        if (isatty(STDIN_FILENO)) appendHistory(command);
+
+        // [command &] starts the job in the background and returns to the prompt
+        int background = stripBackgroundOperator(command);
+        if (strlen(command) == 0) continue;
+
+        // [submit] keeps the whole line, redirections included, for when the job is admitted
+        if (isSubmitCommand(command)) {
+            submitJob(command);
+            continue;
+        }
+
+        // [| tee [-a] files] is handled by the shell itself, it is cut off before parsing
+        char *tee_arguments = extractTeeSuffix(command);
+
+        // [<<WORD] / [<<< text] are cut out of the line before it is parsed
+        int heredoc_fd = extractHereDocument(command);
+        if (heredoc_fd == -2) {
+            free(tee_arguments);
+            continue;
+        }
+
         // get the shell context and process command for execution
         shellcontext *shcntx = processCommand(command);
+        shcntx->heredoc_fd = heredoc_fd;
+        shcntx->tee_arguments = tee_arguments;
 
         //listShellCommands(shcntx->shellcommand);
 
         int errors_exist = 0;
 
-        switch (shellCommandErrorsExist(shcntx)) {
-
-            case 1000: //TOO_MANY_INPUT_REDIRECTS_IN_1_LINE
-                printf("ERROR - Can’t have two input redirects on one line\n");
-                errors_exist = 1;
-                break;
-            case 2000: // NO_REDIRECTION_FILE_SPECIFIED
-                printf("ERROR - No redirection file specified\n");
-                errors_exist = 1;
-                break;
-            case 3000: // TRIPLE_OR_MORE_GREATER_THAN_SYMBOLS
-                printf("ERROR - Cannot have >>> or more [>]\n");
-                errors_exist = 1;
-                break;
-            case 4000: // NO_COMMAND
-                printf("ERROR - No command\n");
-                errors_exist = 1;
-                break;
+        const char *error_message = shellCommandErrorMessage(shellCommandErrorsExist(shcntx));
+        if (error_message != NULL) {
+            printf("%s\n", error_message);
+            errors_exist = 1;
         }
 
         // check for builtin shell commands
         if (!errors_exist && !isBuiltinShellCommand(shelljobs, shcntx)) {
 
-            // create pipes for inter process comm.
-            int stdinPipe[2];
-            int stdoutPipe[2];
-
-            int child_pid;
-            char processOutput;
-            int exec_result_code;
-
-            if (pipe(stdinPipe) < 0) {
-                perror("error creating stdin pipe");
-                return -1;
-            }
-            if (pipe(stdoutPipe) < 0) {
-                close(stdinPipe[PIPE_READ]);
-                close(stdinPipe[PIPE_WRITE]);
-                perror("error creating stdout pipe");
-                return -1;
-            }
-
-            child_pid = fork();
-            if (0 == child_pid) { //child
-
-                // bypass stdinlogic check
-                int bypassStdinLogicCheck = 0;
-                // logic for dealing with redirects
-
-                if ((shcntx->shellcommand->next != NULL) &&
-                    (shcntx->shellcommand->proceeding_special_character == GREATER_THAN_SYMBOL) &&
-                    (shcntx->shellcommand->next->next != NULL) &&
-                    (shcntx->shellcommand->next->proceeding_special_character == LESS_THAN_SYMBOL)) {
-                    // handle the [  sort>out.txt<file.txt ] edge case
-
-                    int fin = open(shcntx->shellcommand->next->next->command, O_RDONLY);
-                    if (dup2(fin, STDIN_FILENO) == -1) exit(errno);
-                    close(fin);
-                    // output file is set below
-                    bypassStdinLogicCheck = 1;
-                }
-
-                if (!bypassStdinLogicCheck){
-                    if ((shcntx->shellcommand->next != NULL) &&
-                        (shcntx->shellcommand->proceeding_special_character == LESS_THAN_SYMBOL)) {
-                        int fin = open(shcntx->shellcommand->next->command, O_RDONLY);
-                        if (dup2(fin, STDIN_FILENO) == -1) exit(errno);
-                        close(fin);
-                    } else {
-                        if (dup2(stdinPipe[PIPE_READ], STDIN_FILENO) == -1) exit(errno);
-                    }
-                }
-
-                // handle the [command > file.txt] case
-                if (shcntx->shellcommand->next != NULL &&
-                    shcntx->shellcommand->proceeding_special_character ==
-                    GREATER_THAN_SYMBOL) { // write/overrwrite file
-
-                    // open up a file with the correct permissions
-                    int fout = open(shcntx->shellcommand->next->command, O_WRONLY | O_CREAT | O_TRUNC, 06666);
-                    if (dup2(fout, STDOUT_FILENO) == -1) exit(errno);
-                    if (dup2(fout, STDERR_FILENO) == -1) exit(errno);
-                    close(fout);
-                } else if (shcntx->shellcommand->next != NULL &&
-                           shcntx->shellcommand->proceeding_special_character ==
-                           DOUBLE_GREATER_THAN_SYMBOL) { // append to file
-                    // open up a file to append to
-                    int fout = open(shcntx->shellcommand->next->command, O_WRONLY | O_APPEND);
-                    if (dup2(fout, STDOUT_FILENO) == -1) exit(errno);
-                    if (dup2(fout, STDERR_FILENO) == -1) exit(errno);
-                    close(fout);
-                } else { // write to stdout
-                    if (dup2(stdoutPipe[PIPE_WRITE], STDOUT_FILENO) == -1) exit(errno);
-                    if (dup2(stdoutPipe[PIPE_WRITE], STDERR_FILENO) == -1) exit(errno);
-                }
-
-                // close the parent pipes
-                close(stdinPipe[PIPE_READ]);
-                close(stdinPipe[PIPE_WRITE]);
-                close(stdoutPipe[PIPE_READ]);
-                close(stdoutPipe[PIPE_WRITE]);
-
-                // split the arguments based on the whitespace
-                int itor = 0;
-                int next_arr_ele = 0;
-
-                char *argv[100];
-                char tmpbuff[100];
-
-                for (int i = 0; i <= strlen(shcntx->shellcommand->command); i++) {
-
-                    if (((shcntx->shellcommand->command[i] == ' ') ||
-                         (shcntx->shellcommand->command[i] == '\0')) && itor != 0) {
-                        tmpbuff[itor] = '\0';
-                        argv[next_arr_ele] = malloc(itor + 1);
-                        strcpy(argv[next_arr_ele], tmpbuff);
-                        next_arr_ele++;
-                        itor = 0;
-                    } else {
-                        tmpbuff[itor] = shcntx->shellcommand->command[i];
-                        itor++;
-                    }
-                }
-                argv[next_arr_ele] = NULL;
-                exec_result_code = execvp(argv[0], argv);
-
-                // exit with error code, if reaches this point
-                exit(exec_result_code);
-            } else if (child_pid > 0) {
-                // close unused file descriptors, these are for child only
-                close(stdinPipe[PIPE_READ]);
-                close(stdoutPipe[PIPE_WRITE]);
-
-                // create job, store the process output address to read it
-                // this allows us to support bg/fg jobs
-                job *newjob = createJob(child_pid, &processOutput, stdoutPipe[PIPE_READ], RUNNING_FOREGROUND, command);
-                addJobsListJob(shelljobs, newjob);
-
-                while (read(stdoutPipe[PIPE_READ], (void *) newjob->process_stdout_read_address, 1) == 1) {
-                    write(STDOUT_FILENO, (void *) newjob->process_stdout_read_address, 1);
-                }
-            }
+            if (launchCommand(shcntx, command, background, NO_JOB_PRIORITY, -1) == -1) return -1;
 
             if (strcmp(shcntx->shellcommand->base_command, "exit") == 0) {
                 exit(0);
             }
 
             // clean up allocated commands
-            shellcommand *t = shcntx->shellcommand->next;
-            while (t != NULL) {
-                shellcommand *i = t->next;
-                free(t);
-                t = i;
-            }
-            free(shcntx);
+            freeShellContext(shcntx);
         }
+
+        // the child has its own copy of the here-document
+        if (heredoc_fd >= 0) close(heredoc_fd);
     }
     return 0;
 }